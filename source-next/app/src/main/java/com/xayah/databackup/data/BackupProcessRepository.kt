@@ -11,6 +11,7 @@ import com.xayah.databackup.database.entity.Mms
 import com.xayah.databackup.database.entity.Network
 import com.xayah.databackup.database.entity.Sms
 import com.xayah.databackup.entity.BackupConfig
+import com.xayah.databackup.rootservice.RemoteRootService
 import com.xayah.databackup.service.BackupService
 import com.xayah.databackup.util.ShellHelper
 import kotlinx.coroutines.flow.MutableStateFlow
@@ -220,7 +221,10 @@ class BackupProcessRepository(
     suspend fun cancel() {
         if (mIsCanceled.not()) {
             mIsCanceled = true
-            ShellHelper.killRootService()
+            // Terminates the running tar jobs only, the root service stays usable for cleaning up.
+            if (RemoteRootService.cancelTarJobs().not()) {
+                ShellHelper.killRootService()
+            }
         }
     }
 
@@ -302,7 +306,8 @@ class BackupProcessRepository(
     }
 
     fun updateAppsItem(onUpdate: ProcessItem.() -> ProcessItem) {
-        _appsItem.value = onUpdate(_appsItem.value)
+        // Several apps are backed up concurrently.
+        _appsItem.update { onUpdate(it) }
     }
 
     fun updateFilesItem(onUpdate: ProcessItem.() -> ProcessItem) {
@@ -325,23 +330,30 @@ class BackupProcessRepository(
         _messagesItem.value = onUpdate(_messagesItem.value)
     }
 
-    fun addProcessAppItem(item: ProcessAppItem) {
+    /**
+     * Returns the index of [item] for [updateProcessAppItem].
+     */
+    fun addProcessAppItem(item: ProcessAppItem): Int {
+        var index = -1
         _processAppItems.update {
             val items = it.toMutableList()
+            index = items.size
             items.add(item)
             items
         }
-    }
-
-    fun updateProcessAppItem(onUpdate: ProcessAppItem.() -> ProcessAppItem) {
-        val currentList = _processAppItems.value
-        val newList = currentList.mapIndexed { index, item ->
-            if (index == currentList.size - 1) {
-                onUpdate(item)
-            } else {
-                item
+        return index
+    }
+
+    fun updateProcessAppItem(itemIndex: Int, onUpdate: ProcessAppItem.() -> ProcessAppItem) {
+        // Apps and the archive jobs of each app report progress concurrently.
+        _processAppItems.update { currentList ->
+            currentList.mapIndexed { index, item ->
+                if (index == itemIndex) {
+                    onUpdate(item)
+                } else {
+                    item
+                }
             }
         }
-        _processAppItems.value = newList
     }
 }
@@ -25,25 +25,27 @@ class RusticBackupCoordinator(
         val createdAt = System.currentTimeMillis()
         val stagingPath = PathHelper.getRusticStagingDir(selection.config.uuidString, createdAt)
 
+        var session = -1L
         try {
             onEvent(RusticBackupEvent.StageChanged(RusticBackupStage.PrepareRepository))
-            mGateway.prepareRepository(repositoryPath, backend.password)
+            session = mGateway.openSession(repositoryPath, backend.password)
 
             onEvent(RusticBackupEvent.StageChanged(RusticBackupStage.CollectSources))
             val collected = mSourceCollector.collect(selection, stagingPath, createdAt)
 
             onEvent(RusticBackupEvent.StageChanged(RusticBackupStage.CreateSnapshot))
-            val snapshotId = mGateway.createSnapshot(
-                repositoryPath = repositoryPath,
-                password = backend.password,
-                sourcePaths = collected.sourcePaths,
+            // A backup is a single snapshot, the staged metadata describes all of its sources and the result
+            // refers to it by one ID, so the sources go in as one set instead of a snapshot per app.
+            val snapshotId = mGateway.createSnapshots(
+                session = session,
+                sourceSets = listOf(collected.sourcePaths),
                 tags = listOf(
                     SNAPSHOT_TAG,
                     "$SNAPSHOT_CONFIG_TAG_PREFIX${selection.config.uuidString}",
                 )
             ) { bytesDone, speed, progress ->
                 onEvent(RusticBackupEvent.Progress(bytesDone, speed, progress))
-            }.takeIf { it.isNotBlank() } ?: throw IllegalStateException("Rustic returned an empty snapshot ID.")
+            }.firstOrNull()?.takeIf { it.isNotBlank() } ?: throw IllegalStateException("Rustic returned an empty snapshot ID.")
 
             onEvent(RusticBackupEvent.StageChanged(RusticBackupStage.FinalizeSnapshot))
             try {
@@ -54,6 +56,7 @@ class RusticBackupCoordinator(
 
             return RusticBackupResult(snapshotId, collected.sourcePaths.size, collected.skippedSources)
         } finally {
+            if (session > 0) mGateway.closeSession(session)
             // Staged metadata is temporary and must not survive a completed or failed backup.
             if (mGateway.deleteRecursively(stagingPath).not()) {
                 LogHelper.w(TAG, "start", "Failed to clean Rustic staging directory.")
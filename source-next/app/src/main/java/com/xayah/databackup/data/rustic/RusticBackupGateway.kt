@@ -47,17 +47,32 @@ class RusticBackupGateway {
         }
     }
 
-    suspend fun createSnapshot(
-        repositoryPath: String,
-        password: String,
-        sourcePaths: List<String>,
+    /**
+     * Prepares the repository like [prepareRepository] and opens a session on it. Opening validates the
+     * config and credentials, so an existing repository is only opened once.
+     */
+    suspend fun openSession(repositoryPath: String, password: String): Long {
+        if (repositoryExists(repositoryPath).not()) {
+            prepareRepository(repositoryPath, password)
+        }
+        val session = RemoteRootService.openRusticSession(repositoryPath, password)
+        if (session <= 0) {
+            throw IllegalStateException("Failed to open a Rustic repository session.")
+        }
+        return session
+    }
+
+    suspend fun closeSession(session: Long): Boolean = RemoteRootService.closeRusticSession(session)
+
+    suspend fun createSnapshots(
+        session: Long,
+        sourceSets: List<List<String>>,
         tags: List<String>,
         onProgress: (Long, Long, Float) -> Unit,
-    ): String {
-        return RemoteRootService.createRusticSnapshot(
-            repositoryPath = repositoryPath,
-            password = password,
-            sourcePaths = sourcePaths,
+    ): List<String> {
+        return RemoteRootService.createRusticSessionSnapshots(
+            session = session,
+            sourceSets = sourceSets,
             tags = tags,
             callback = object : ICallback.Stub() {
                 override fun onProgress(bytesWritten: Long, speed: Long, progress: Float) {
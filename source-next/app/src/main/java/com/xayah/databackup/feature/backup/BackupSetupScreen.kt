@@ -47,7 +47,12 @@ import com.xayah.databackup.feature.BackupNetworksRoute
 import com.xayah.databackup.feature.BackupProcessRoute
 import com.xayah.databackup.feature.RusticBackupProcessRoute
 import com.xayah.databackup.ui.component.ActionButtonState
+import com.xayah.databackup.ui.component.AdaptiveCompressionSwitch
 import com.xayah.databackup.ui.component.AutoScreenOffSwitch
+import com.xayah.databackup.ui.component.ExtDataTextLevelPreference
+import com.xayah.databackup.ui.component.IntDataTextLevelPreference
+import com.xayah.databackup.ui.component.MaxArchiveJobsPreference
+import com.xayah.databackup.ui.component.NativeTracingSwitch
 import com.xayah.databackup.ui.component.Preference
 import com.xayah.databackup.ui.component.PreferenceGroup
 import com.xayah.databackup.ui.component.ResetBackupListSwitch
@@ -424,5 +429,10 @@ private fun Settings() {
     PreferenceGroup(modifier = Modifier.padding(horizontal = 16.dp)) {
         AutoScreenOffSwitch()
         ResetBackupListSwitch()
+        AdaptiveCompressionSwitch()
+        IntDataTextLevelPreference()
+        ExtDataTextLevelPreference()
+        MaxArchiveJobsPreference()
+        NativeTracingSwitch()
     }
 }
@@ -7,21 +7,24 @@ import kotlinx.coroutines.SupervisorJob
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.isActive
 import kotlinx.coroutines.launch
-import java.io.OutputStream
+import java.io.Closeable
 import kotlin.math.roundToLong
 import kotlin.time.Duration
 import kotlin.time.Duration.Companion.seconds
 
-class CountingOutputStream(
-    private val source: OutputStream,
+/**
+ * Polls a byte counter owned by native code and reports it like a counting stream would.
+ */
+class ProgressListener(
     private val interval: Duration = 1.seconds,
+    private val readBytes: () -> Long,
     private val onProgress: ((bytesWritten: Long, speed: Long) -> Unit)? = null
-) : OutputStream() {
-    @Volatile
-    private var mBytesWritten: Long = 0L
+) : Closeable {
     private var mLastBytesWritten: Long = 0L
     private val mScope: CoroutineScope = CoroutineScope(SupervisorJob() + Dispatchers.Default)
     private var mListener: Job? = null
+
+    @Volatile
     private var mIsClosed: Boolean = false
     private var mStartTimestamp: Long = 0L
     private var mEndTimestamp: Long = 0L
@@ -35,7 +38,7 @@ class CountingOutputStream(
         if (onProgress != null) {
             mListener = mScope.launch {
                 while (isActive && mIsClosed.not()) {
-                    val currentBytes = mBytesWritten
+                    val currentBytes = readBytes()
                     val delta = currentBytes - mLastBytesWritten
                     val speed = delta / interval.inWholeSeconds
                     mLastBytesWritten = currentBytes
@@ -48,31 +51,14 @@ class CountingOutputStream(
         }
     }
 
-    override fun write(b: Int) {
-        source.write(b)
-        mBytesWritten++
-    }
-
-    override fun write(b: ByteArray) {
-        source.write(b)
-        mBytesWritten += b.size
-    }
-
-    override fun write(b: ByteArray, off: Int, len: Int) {
-        source.write(b, off, len)
-        mBytesWritten += len
-    }
-
-    override fun flush() = source.flush()
-
     override fun close() {
         mIsClosed = true
         mEndTimestamp = System.currentTimeMillis()
-        if (mBytesWritten != 0L) {
-            val speed = (mBytesWritten / ((mEndTimestamp - mStartTimestamp).toFloat() / 1000)).roundToLong()
-            onProgress?.invoke(mBytesWritten, speed)
-        }
         mListener?.cancel()
-        source.close()
+        val bytesWritten = readBytes()
+        if (bytesWritten != 0L) {
+            val speed = (bytesWritten / ((mEndTimestamp - mStartTimestamp).toFloat() / 1000)).roundToLong()
+            onProgress?.invoke(bytesWritten, speed)
+        }
     }
 }
@@ -22,7 +22,6 @@ import android.os.ParcelFileDescriptor
 import android.os.RemoteException
 import android.os.StatFs
 import android.os.UserManagerHidden
-import com.github.luben.zstd.ZstdOutputStream
 import com.topjohnwu.superuser.ipc.RootService
 import com.xayah.databackup.App
 import com.xayah.databackup.R
@@ -34,6 +33,7 @@ import com.xayah.databackup.parcelables.BytesParcelable
 import com.xayah.databackup.parcelables.FilePathParcelable
 import com.xayah.databackup.parcelables.StatFsParcelable
 import com.xayah.databackup.util.LogHelper
+import com.xayah.databackup.util.NativeTraceHelper
 import com.xayah.databackup.util.NotificationHelper
 import com.xayah.databackup.util.NotificationHelper.NOTIFICATION_ID_APPS_UPDATE_WORKER
 import com.xayah.databackup.util.ParcelableHelper.marshall
@@ -41,9 +41,11 @@ import com.xayah.databackup.util.ParcelableHelper.unmarshall
 import com.xayah.databackup.util.PathHelper
 import com.xayah.databackup.util.PathHelper.TMP_PARCEL_PREFIX
 import com.xayah.databackup.util.PathHelper.TMP_SUFFIX
+import com.xayah.databackup.util.ZstdHelper
 import com.xayah.hiddenapi.castTo
 import com.xayah.libnative.NativeLib
 import com.xayah.libnative.Rustic
+import com.xayah.libnative.Trace
 import com.xayah.libnative.TarWrapper
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.delay
@@ -54,8 +56,7 @@ import kotlinx.coroutines.sync.withLock
 import kotlinx.coroutines.withContext
 import kotlinx.coroutines.withTimeout
 import java.io.File
-import java.io.FileInputStream
-import java.io.FileOutputStream
+import java.util.concurrent.ConcurrentHashMap
 import kotlin.coroutines.resume
 import kotlin.coroutines.resumeWithException
 
@@ -63,6 +64,23 @@ object RemoteRootService {
     private const val TAG = "RemoteRootService"
     private const val TIMEOUT_10S = 10000L
     private const val TIMEOUT_30S = 30000L
+    private const val STORAGE_BATCH_SIZE = 32
+    private const val STORAGE_PATHS_PER_PACKAGE = 6
+
+    // android_filesystem_config.h
+    private const val AID_USER_OFFSET = 100000
+    private const val AID_APP_START = 10000
+    private const val AID_APP_END = 19999
+    private const val AID_CACHE_GID_START = 20000
+
+    /**
+     * multiuser_get_cache_gid() of libcutils, -1 for uids that are not apps.
+     */
+    private fun getCacheGid(uid: Int): Int {
+        val appId = uid % AID_USER_OFFSET
+        if (appId !in AID_APP_START..AID_APP_END) return -1
+        return (uid / AID_USER_OFFSET) * AID_USER_OFFSET + AID_CACHE_GID_START + (appId - AID_APP_START)
+    }
 
     private fun writeToParcel(context: Context, block: (Parcel) -> Unit): ParcelFileDescriptor {
         val parcel = Parcel.obtain()
@@ -99,6 +117,7 @@ object RemoteRootService {
 
     class Service : RootService() {
         init {
+            System.loadLibrary("trace")
             System.loadLibrary("nativelib")
             System.loadLibrary("tar-wrapper")
             System.loadLibrary("rustic")
@@ -108,6 +127,11 @@ object RemoteRootService {
         override fun onBind(intent: Intent): IBinder = Impl(applicationContext).apply { onBind() }
     }
 
+    /**
+     * Root service side state of a native tar job, dropped once [IRemoteRootService.waitTarJob] saw it finish.
+     */
+    private class TarJob(val progress: Long, val listener: ProgressListener, val onFinished: (status: Int) -> Int)
+
     private class Impl(private val context: Context) : IRemoteRootService.Stub() {
         private lateinit var mSystemContext: Context
         private lateinit var mPackageManager: PackageManager
@@ -164,31 +188,39 @@ object RemoteRootService {
                 users.forEach { user ->
                     packages.addAll(mPackageManagerHidden.getInstalledPackagesAsUser(0, user.id).map { user.id to it })
                 }
-                storages.addAll(packages.mapIndexed { index, (userId, item) ->
+                // Sizes are calculated in batches so the walker can keep all cores busy.
+                packages.chunked(STORAGE_BATCH_SIZE).forEachIndexed { batchIndex, batch ->
+                    val (_, first) = batch.first()
                     builder.setContentTitle(context.getString(R.string.worker_update_apps_storage_info))
-                        .setSubText(item.applicationInfo?.loadLabel(mPackageManager) ?: item.packageName)
-                        .setProgress(packages.size, index, false)
+                        .setSubText(first.applicationInfo?.loadLabel(mPackageManager) ?: first.packageName)
+                        .setProgress(packages.size, batchIndex * STORAGE_BATCH_SIZE, false)
                         .setOngoing(true)
                     manager.notify(NOTIFICATION_ID_APPS_UPDATE_WORKER, builder.build())
-                    val apkBytes = runCatching {
-                        item.applicationInfo?.sourceDir?.let { path -> File(path).parent }?.let { path -> NativeLib.calculateTreeSize(path) }
-                    }.getOrNull() ?: 0
-                    val userBytes = NativeLib.calculateTreeSize(PathHelper.getAppUserDir(userId, item.packageName))
-                    val userDeBytes = NativeLib.calculateTreeSize(PathHelper.getAppUserDeDir(userId, item.packageName))
-                    val dataBytes = NativeLib.calculateTreeSize(PathHelper.getAppDataDir(userId, item.packageName))
-                    val obbBytes = NativeLib.calculateTreeSize(PathHelper.getAppObbDir(userId, item.packageName))
-                    val mediaBytes = NativeLib.calculateTreeSize(PathHelper.getAppMediaDir(userId, item.packageName))
-                    AppStorage(
-                        packageName = item.packageName,
-                        userId = userId,
-                        storage = Storage(
-                            apkBytes = apkBytes,
-                            internalDataBytes = userBytes + userDeBytes,
-                            externalDataBytes = dataBytes,
-                            additionalDataBytes = obbBytes + mediaBytes,
+                    val paths = batch.flatMap { (userId, item) ->
+                        listOf(
+                            item.applicationInfo?.sourceDir?.let { path -> File(path).parent } ?: "",
+                            PathHelper.getAppUserDir(userId, item.packageName),
+                            PathHelper.getAppUserDeDir(userId, item.packageName),
+                            PathHelper.getAppDataDir(userId, item.packageName),
+                            PathHelper.getAppObbDir(userId, item.packageName),
+                            PathHelper.getAppMediaDir(userId, item.packageName),
                         )
-                    )
-                })
+                    }
+                    val sizes = NativeLib.calculateTreeSizes(paths.toTypedArray())
+                    storages.addAll(batch.mapIndexed { index, (userId, item) ->
+                        val offset = index * STORAGE_PATHS_PER_PACKAGE
+                        AppStorage(
+                            packageName = item.packageName,
+                            userId = userId,
+                            storage = Storage(
+                                apkBytes = sizes[offset],
+                                internalDataBytes = sizes[offset + 1] + sizes[offset + 2],
+                                externalDataBytes = sizes[offset + 3],
+                                additionalDataBytes = sizes[offset + 4] + sizes[offset + 5],
+                            )
+                        )
+                    })
+                }
                 parcel.writeTypedList(storages)
             }
         }
@@ -237,15 +269,18 @@ object RemoteRootService {
             }
         }
 
-        override fun writeText(path: String, pfd: ParcelFileDescriptor) {
+        override fun writeText(path: String, pfd: ParcelFileDescriptor): Boolean {
             var text = ""
             readFromParcel(pfd) { parcel -> parcel.readString()?.also { text = it } }
-            val textFile = File(path)
-            if (textFile.isDirectory || textFile.exists()) {
-                textFile.deleteRecursively()
-            }
-            textFile.createNewFile()
-            textFile.writeText(text)
+            return runCatching {
+                val textFile = File(path)
+                if (textFile.isDirectory || textFile.exists()) {
+                    textFile.deleteRecursively()
+                }
+                textFile.createNewFile()
+                textFile.writeText(text)
+                true
+            }.getOrNull() ?: false
         }
 
         override fun calculateTreeSize(path: String): Long {
@@ -265,23 +300,142 @@ object RemoteRootService {
             return sourceDirList
         }
 
-        override fun compress(level: Int, inputPath: String, outputPath: String, callback: ICallback?): String? {
-            runCatching {
-                FileInputStream(inputPath).use { fileInputStream ->
-                    FileOutputStream(outputPath).use { fileOutputStream ->
-                        CountingOutputStream(
-                            source = fileOutputStream,
-                            onProgress = if (callback != null) { bytesWritten, speed -> callback.onProgress(bytesWritten, speed, 0f) } else null
-                        ).use { countingOutputStream ->
-                            ZstdOutputStream(countingOutputStream, level).use { zstdOutputStream ->
-                                zstdOutputStream.setWorkers(Runtime.getRuntime().availableProcessors())
-                                fileInputStream.copyTo(zstdOutputStream)
-                            }
-                        }
+        private val mTarJobs = ConcurrentHashMap<Long, TarJob>()
+
+        // Archives running at once share the cores, see setMaxTarJobs.
+        @Volatile
+        private var mMaxTarJobs = 1
+
+        private fun startTarJob(callback: ICallback?, onFinished: (status: Int) -> Int = { it }, spawn: (progress: Long) -> Long): Long {
+            val progress = TarWrapper.newProgress()
+            val job = spawn(progress)
+            if (job == -1L) {
+                TarWrapper.freeProgress(progress)
+                return -1
+            }
+            val listener = ProgressListener(
+                readBytes = { TarWrapper.readProgress(progress) },
+                onProgress = if (callback != null) { bytes, speed -> callback.onProgress(bytes, speed, 0f) } else null
+            )
+            mTarJobs[job] = TarJob(progress, listener, onFinished)
+            return job
+        }
+
+        override fun startArchive(
+            stdErr: String,
+            roots: Array<String>,
+            outputPath: String,
+            level: Int,
+            adaptive: Boolean,
+            fastLevel: Int,
+            textLevel: Int,
+            callback: ICallback?
+        ): Long {
+            val mode = ParcelFileDescriptor.MODE_WRITE_ONLY or ParcelFileDescriptor.MODE_CREATE or ParcelFileDescriptor.MODE_TRUNCATE
+            return ParcelFileDescriptor.open(File(outputPath), mode).use { pfd ->
+                startTarJob(callback) { progress ->
+                    val workers = (Runtime.getRuntime().availableProcessors() / mMaxTarJobs).coerceAtLeast(1)
+                    TarWrapper.spawnArchive(stdErr, roots, pfd.fd, level, adaptive, fastLevel, textLevel, workers, progress)
+                }
+            }
+        }
+
+        /**
+         * Runs restorecon on [path], -D as app data below /data/data and /data/user is skipped otherwise.
+         */
+        private fun restoreContexts(path: String): Boolean = runCatching {
+            val process = ProcessBuilder("restorecon", "-RFD", path).redirectErrorStream(true).start()
+            val output = process.inputStream.bufferedReader().use { it.readText() }
+            val exitCode = process.waitFor()
+            if (exitCode != 0) {
+                LogHelper.w(TAG, "restoreContexts", "restorecon $path exited with $exitCode: $output")
+            }
+            exitCode == 0
+        }.onFailure {
+            LogHelper.e(TAG, "restoreContexts", "Failed to run restorecon on $path.", it)
+        }.getOrDefault(false)
+
+        override fun startExtract(stdErr: String, inputPath: String, destination: String, ownerPath: String, callback: ICallback?): Long {
+            // Read the owners before extracting, tar restores the owners recorded in the archive.
+            // Same rules as the shell restore: app data is uid:uid, external data takes the group of the
+            // Android/data, obb or media directory above it, and cache trees keep the cache gid installd gave them.
+            val (uid, ownerGid) = NativeLib.getUidGid(ownerPath).let { it[0] to it[1] }
+            val isAppData = ownerGid == uid
+            val gid = if (isAppData) uid else NativeLib.getUidGid(destination)[1]
+            val cacheGid = NativeLib.getUidGid("$ownerPath/cache")[1].takeIf { it != -1 }
+                ?: getCacheGid(uid).takeIf { isAppData && it != -1 } ?: gid
+            val onFinished = { status: Int ->
+                if (status == 0 && uid != -1 && gid != -1) {
+                    val failures = NativeLib.fixOwnership(ownerPath, uid, gid, cacheGid)
+                    if (failures != 0) {
+                        LogHelper.w(TAG, "startExtract", "Failed to fix ownership of $failures entries in $ownerPath.")
                     }
+                    restoreContexts(ownerPath)
                 }
-            }.onFailure { return it.message }
-            return null
+                status
+            }
+            return ParcelFileDescriptor.open(File(inputPath), ParcelFileDescriptor.MODE_READ_ONLY).use { pfd ->
+                startTarJob(callback, onFinished) { progress -> TarWrapper.spawnExtract(stdErr, pfd.fd, destination, progress) }
+            }
+        }
+
+        override fun waitTarJob(job: Long, timeoutMs: Long): Int {
+            val status = TarWrapper.waitFor(job, timeoutMs)
+            if (status == TarWrapper.JOB_RUNNING) return status
+            TarWrapper.release(job)
+            val tarJob = mTarJobs.remove(job) ?: return status
+            tarJob.listener.close()
+            TarWrapper.freeProgress(tarJob.progress)
+            return tarJob.onFinished(status)
+        }
+
+        override fun cancelTarJob(job: Long): Boolean {
+            return TarWrapper.cancel(job)
+        }
+
+        override fun cancelTarJobs() {
+            TarWrapper.cancelAll()
+        }
+
+        override fun setMaxTarJobs(maxJobs: Int) {
+            mMaxTarJobs = maxJobs.coerceAtLeast(1)
+            TarWrapper.setMaxJobs(maxJobs)
+        }
+
+        override fun scanManifest(manifestPath: String, roots: Array<String>, settings: String): Long {
+            return NativeLib.scanManifest(manifestPath, roots, settings)
+        }
+
+        override fun commitManifest(manifestPath: String): Boolean {
+            return NativeLib.commitManifest(manifestPath)
+        }
+
+        override fun discardManifest(manifestPath: String) {
+            NativeLib.discardManifest(manifestPath)
+        }
+
+        override fun hashFiles(paths: Array<String>): Array<String> {
+            return NativeLib.hashFiles(paths)
+        }
+
+        override fun storeObject(sourcePath: String, objectPath: String, contentId: String): Boolean {
+            return runCatching {
+                val target = File(objectPath)
+                val hashOf = { file: File -> NativeLib.hashFiles(arrayOf(file.path)).firstOrNull() }
+                if (target.exists() && hashOf(target) == contentId) return true
+                target.parentFile?.mkdirs()
+                // Readers must never see a partial object, its name promises the content. Workers may store
+                // the same object at once, so each one stages its own copy and the renames replace each other.
+                val tmpFile = File.createTempFile("${target.name}.", TMP_SUFFIX, target.parentFile)
+                try {
+                    File(sourcePath).copyTo(tmpFile, overwrite = true)
+                    // The source may have changed since it was hashed, only the copy is known to match the name.
+                    if (hashOf(tmpFile) != contentId) return false
+                    tmpFile.renameTo(target) || hashOf(target) == contentId
+                } finally {
+                    tmpFile.delete()
+                }
+            }.getOrNull() ?: false
         }
 
         override fun mkdirs(path: String): Boolean {
@@ -303,6 +457,22 @@ object RemoteRootService {
             return runCatching { File(source).copyRecursively(File(target), overwrite) }.getOrNull() ?: false
         }
 
+        override fun setNativeTraceEnabled(enabled: Boolean) {
+            Trace.setEnabled(enabled)
+        }
+
+        override fun resetNativeTrace() {
+            Trace.reset()
+        }
+
+        override fun readNativeTraceCounters(): String {
+            return Trace.readCounters()
+        }
+
+        override fun dumpNativeTrace(path: String): Boolean {
+            return Trace.dumpChromeTrace(path)
+        }
+
         override fun initRusticRepository(repositoryPath: String, password: String) {
             Rustic.initRepository(repositoryPath, password)
         }
@@ -332,6 +502,34 @@ object RemoteRootService {
         override fun checkRusticRepository(repositoryPath: String, password: String) {
             Rustic.checkRepository(repositoryPath, password)
         }
+
+        override fun openRusticSession(repositoryPath: String, password: String): Long {
+            return Rustic.openSession(repositoryPath, password)
+        }
+
+        override fun createRusticSessionSnapshots(
+            session: Long,
+            sourcePaths: List<String>,
+            sourceSetSizes: IntArray,
+            tags: List<String>,
+            callback: ICallback?
+        ): List<String> {
+            val sourceSets = mutableListOf<List<String>>()
+            var start = 0
+            sourceSetSizes.forEach { size ->
+                sourceSets.add(sourcePaths.subList(start, start + size))
+                start += size
+            }
+            return Rustic.createSessionSnapshots(session, sourceSets, tags, callback)
+        }
+
+        override fun restoreRusticSessionSnapshot(session: Long, snapshotId: String, destinationPath: String, callback: ICallback?) {
+            Rustic.restoreSessionSnapshot(session, snapshotId, destinationPath, callback)
+        }
+
+        override fun closeRusticSession(session: Long): Boolean {
+            return Rustic.closeSession(session)
+        }
     }
 
     private fun destroyService() {
@@ -502,13 +700,13 @@ object RemoteRootService {
         return text
     }
 
-    suspend fun writeText(path: String, text: String) {
-        getService()?.writeText(
+    suspend fun writeText(path: String, text: String): Boolean {
+        return getService()?.writeText(
             path,
             writeToParcel(App.application) { parcel ->
                 parcel.writeString(text)
             }
-        )
+        ) ?: false
     }
 
     suspend fun calculateTreeSize(path: String): Long {
@@ -523,8 +721,65 @@ object RemoteRootService {
         return getService()?.getPackageSourceDir(packageName, userId) ?: listOf()
     }
 
-    suspend fun compress(level: Int, inputPath: String, outputPath: String, callback: ICallback?): String? {
-        return getService()?.compress(level, inputPath, outputPath, callback)
+    suspend fun startArchive(
+        stdErr: String,
+        roots: Array<String>,
+        outputPath: String,
+        level: Int,
+        adaptive: Boolean,
+        fastLevel: Int,
+        textLevel: Int,
+        callback: ICallback?
+    ): Long {
+        return getService()?.startArchive(stdErr, roots, outputPath, level, adaptive, fastLevel, textLevel, callback) ?: -1
+    }
+
+    /**
+     * Extracts [inputPath] into [destination] as a traced restore run and waits for it like [ZstdHelper.awaitTarJob].
+     */
+    suspend fun extract(stdErr: String, inputPath: String, destination: String, ownerPath: String, callback: ICallback?): Int {
+        return NativeTraceHelper.traced("restore") {
+            ZstdHelper.awaitTarJob(getService()?.startExtract(stdErr, inputPath, destination, ownerPath, callback) ?: -1)
+        }
+    }
+
+    suspend fun waitTarJob(job: Long, timeoutMs: Long): Int {
+        return getService()?.waitTarJob(job, timeoutMs) ?: -1
+    }
+
+    suspend fun cancelTarJob(job: Long): Boolean {
+        return getService()?.cancelTarJob(job) ?: false
+    }
+
+    /**
+     * Returns false if the root service is unavailable.
+     */
+    suspend fun cancelTarJobs(): Boolean {
+        return getService()?.cancelTarJobs() != null
+    }
+
+    suspend fun setMaxTarJobs(maxJobs: Int) {
+        getService()?.setMaxTarJobs(maxJobs)
+    }
+
+    suspend fun scanManifest(manifestPath: String, roots: Array<String>, settings: String): Long {
+        return getService()?.scanManifest(manifestPath, roots, settings) ?: -1
+    }
+
+    suspend fun commitManifest(manifestPath: String): Boolean {
+        return getService()?.commitManifest(manifestPath) ?: false
+    }
+
+    suspend fun discardManifest(manifestPath: String) {
+        getService()?.discardManifest(manifestPath)
+    }
+
+    suspend fun hashFiles(paths: Array<String>): Array<String> {
+        return getService()?.hashFiles(paths) ?: arrayOf()
+    }
+
+    suspend fun storeObject(sourcePath: String, objectPath: String, contentId: String): Boolean {
+        return getService()?.storeObject(sourcePath, objectPath, contentId) ?: false
     }
 
     suspend fun mkdirs(path: String): Boolean {
@@ -543,6 +798,22 @@ object RemoteRootService {
         return getService()?.copyRecursively(source, target, overwrite) ?: false
     }
 
+    suspend fun setNativeTraceEnabled(enabled: Boolean) {
+        getService()?.setNativeTraceEnabled(enabled)
+    }
+
+    suspend fun resetNativeTrace() {
+        getService()?.resetNativeTrace()
+    }
+
+    suspend fun readNativeTraceCounters(): String {
+        return getService()?.readNativeTraceCounters() ?: ""
+    }
+
+    suspend fun dumpNativeTrace(path: String): Boolean {
+        return getService()?.dumpNativeTrace(path) ?: false
+    }
+
     suspend fun initRusticRepository(repositoryPath: String, password: String) {
         getService()?.initRusticRepository(repositoryPath, password)
     }
@@ -566,10 +837,40 @@ object RemoteRootService {
     }
 
     suspend fun restoreRusticSnapshot(repositoryPath: String, password: String, snapshotId: String, destinationPath: String) {
-        getService()?.restoreRusticSnapshot(repositoryPath, password, snapshotId, destinationPath)
+        NativeTraceHelper.traced("restore") {
+            getService()?.restoreRusticSnapshot(repositoryPath, password, snapshotId, destinationPath)
+        }
     }
 
     suspend fun checkRusticRepository(repositoryPath: String, password: String) {
         getService()?.checkRusticRepository(repositoryPath, password)
     }
+
+    suspend fun openRusticSession(repositoryPath: String, password: String): Long {
+        return getService()?.openRusticSession(repositoryPath, password) ?: -1
+    }
+
+    /**
+     * Backs up [sourceSets] into one snapshot each within [session], returns their IDs in order.
+     */
+    suspend fun createRusticSessionSnapshots(
+        session: Long,
+        sourceSets: List<List<String>>,
+        tags: List<String> = emptyList(),
+        callback: ICallback? = null,
+    ): List<String> {
+        val sourcePaths = sourceSets.flatten()
+        val sourceSetSizes = sourceSets.map { it.size }.toIntArray()
+        return getService()?.createRusticSessionSnapshots(session, sourcePaths, sourceSetSizes, tags, callback) ?: listOf()
+    }
+
+    suspend fun restoreRusticSessionSnapshot(session: Long, snapshotId: String, destinationPath: String, callback: ICallback? = null) {
+        NativeTraceHelper.traced("restore") {
+            getService()?.restoreRusticSessionSnapshot(session, snapshotId, destinationPath, callback)
+        }
+    }
+
+    suspend fun closeRusticSession(session: Long): Boolean {
+        return getService()?.closeRusticSession(session) ?: false
+    }
 }
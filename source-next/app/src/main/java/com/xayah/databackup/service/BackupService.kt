@@ -22,6 +22,7 @@ import com.xayah.databackup.service.util.BackupContactsHelper
 import com.xayah.databackup.service.util.BackupMessagesHelper
 import com.xayah.databackup.service.util.BackupNetworksHelper
 import com.xayah.databackup.util.LogHelper
+import com.xayah.databackup.util.NativeTraceHelper
 import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.flow.first
 import kotlinx.coroutines.isActive
@@ -108,35 +109,37 @@ object BackupService {
         }
 
         suspend fun start() {
-            try {
-                ensureNotCanceled("apps backup")
-                if (mAppRepo.isBackupAppsSelected.first()) {
-                    backupApps()
-                }
+            NativeTraceHelper.traced("backup") {
+                try {
+                    ensureNotCanceled("apps backup")
+                    if (mAppRepo.isBackupAppsSelected.first()) {
+                        backupApps()
+                    }
 
-                ensureNotCanceled("networks backup")
-                if (mNetworkRepo.isBackupNetworksSelected.first()) {
-                    backupNetworks()
-                }
+                    ensureNotCanceled("networks backup")
+                    if (mNetworkRepo.isBackupNetworksSelected.first()) {
+                        backupNetworks()
+                    }
 
-                ensureNotCanceled("contacts backup")
-                if (mContactRepo.isBackupMessagesSelected.first()) {
-                    backupContacts()
-                }
+                    ensureNotCanceled("contacts backup")
+                    if (mContactRepo.isBackupMessagesSelected.first()) {
+                        backupContacts()
+                    }
 
-                ensureNotCanceled("call logs backup")
-                if (mCallLogRepo.isBackupCallLogsSelected.first()) {
-                    backupCallLogs()
-                }
+                    ensureNotCanceled("call logs backup")
+                    if (mCallLogRepo.isBackupCallLogsSelected.first()) {
+                        backupCallLogs()
+                    }
 
-                ensureNotCanceled("messages backup")
-                if (mMessageRepo.isBackupContactsSelected.first()) {
-                    backupMessages()
-                }
+                    ensureNotCanceled("messages backup")
+                    if (mMessageRepo.isBackupContactsSelected.first()) {
+                        backupMessages()
+                    }
 
-                setupBackupConfig()
-            } catch (e: CancellationException) {
-                LogHelper.i(TAG, "start", "Backup pipeline canceled and exited early: ${e.message}")
+                    setupBackupConfig()
+                } catch (e: CancellationException) {
+                    LogHelper.i(TAG, "start", "Backup pipeline canceled and exited early: ${e.message}")
+                }
             }
         }
     }
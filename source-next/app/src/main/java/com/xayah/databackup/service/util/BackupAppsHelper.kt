@@ -30,18 +30,34 @@ import com.xayah.databackup.data.subtitle
 import com.xayah.databackup.database.entity.App
 import com.xayah.databackup.rootservice.ICallback
 import com.xayah.databackup.rootservice.RemoteRootService
+import com.xayah.databackup.util.AdaptiveCompressionBackup
+import com.xayah.databackup.util.ExtDataTextLevelBackup
+import com.xayah.databackup.util.IntDataTextLevelBackup
 import com.xayah.databackup.util.LogHelper
+import com.xayah.databackup.util.MaxArchiveJobsBackup
 import com.xayah.databackup.util.PathHelper
 import com.xayah.databackup.util.ZstdHelper
 import com.xayah.databackup.util.formatToStorageSize
 import com.xayah.databackup.util.formatToStorageSizePerSecond
+import com.xayah.databackup.util.readBoolean
+import com.xayah.databackup.util.readInt
 import kotlinx.coroutines.CancellationException
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.flow.first
+import kotlinx.coroutines.launch
+import java.util.concurrent.atomic.AtomicInteger
 
 class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository) {
     companion object {
         private const val TAG = "BackupAppsHelper"
     }
 
+    private var mAdaptiveCompression = AdaptiveCompressionBackup.second
+    private var mIntDataTextLevel = IntDataTextLevelBackup.second
+    private var mExtDataTextLevel = ExtDataTextLevelBackup.second
+
     private fun getMsgByStatus(status: Int): String {
         return when (status) {
             STATUS_SUCCESS -> application.getString(R.string.succeed)
@@ -83,12 +99,56 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
     }
 
-    private suspend fun packageAndCompressApk(app: App, onProgress: (bytesWritten: Long, speed: Long) -> Unit): Pair<Int, String> {
+    /**
+     * Archives [roots] into [outputPath] unless nothing below them and none of the compression settings changed
+     * since that archive was written, which is tracked by a manifest next to it.
+     */
+    private suspend fun packageAndCompressIfChanged(
+        outputPath: String,
+        roots: Array<String>,
+        textLevel: Int,
+        onProgress: (bytesWritten: Long, speed: Long) -> Unit
+    ): Pair<Int, String> {
+        val manifestPath = PathHelper.getManifestFilePath(outputPath)
+        val settings = ZstdHelper.archiveSettings(adaptive = mAdaptiveCompression, textLevel = textLevel)
+        val changes = RemoteRootService.scanManifest(manifestPath, roots, settings)
+        if (changes == 0L && RemoteRootService.exists(outputPath)) {
+            RemoteRootService.discardManifest(manifestPath)
+            val info = "Unchanged since the last backup: $outputPath."
+            LogHelper.i(TAG, "packageAndCompressIfChanged", info)
+            return STATUS_SUCCESS to info
+        }
+
+        val result = ZstdHelper.packageAndCompress(
+            outputPath = outputPath,
+            callback = object : ICallback.Stub() {
+                override fun onProgress(bytesWritten: Long, speed: Long, progress: Float) {
+                    onProgress(bytesWritten, speed)
+                }
+            },
+            adaptive = mAdaptiveCompression,
+            textLevel = textLevel,
+            roots = roots
+        )
+        // Anything but a clean tar exit (e.g. 1, files changed while reading) must not become the next baseline.
+        if (result.first == STATUS_SUCCESS && changes != -1L) {
+            RemoteRootService.commitManifest(manifestPath)
+        } else {
+            RemoteRootService.discardManifest(manifestPath)
+        }
+        return result
+    }
+
+    /**
+     * Puts every apk of [app] into the content addressed apk store, an apk already stored by another app, user
+     * or backup run is only referenced. The apk index of [app] lists the objects it consists of.
+     */
+    private suspend fun storeApk(app: App, onProgress: (bytesWritten: Long, speed: Long) -> Unit): Pair<Int, String> {
         var status = STATUS_SUCCESS
         var info = ""
         val backupConfig = mBackupProcessRepo.getBackupConfig()
-        val apkPath = PathHelper.getBackupAppsApkFilePath(backupConfig.path, app.packageName)
-        val apkParentPath = PathHelper.getParentPath(apkPath)
+        val indexPath = PathHelper.getBackupAppsApkIndexFilePath(backupConfig.path, app.packageName)
+        val indexParentPath = PathHelper.getParentPath(indexPath)
         val apkList = RemoteRootService.getPackageSourceDir(app.packageName, app.userId)
 
         ensureNotCanceled()
@@ -96,41 +156,62 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         if (apkList.isEmpty()) {
             status = STATUS_ERROR
             info = "Failed to get apk sources."
-            LogHelper.e(TAG, "packageAndCompressApk", info)
+            LogHelper.e(TAG, "storeApk", info)
             return status to info
         }
 
-        if (RemoteRootService.mkdirs(apkParentPath).not()) {
+        if (RemoteRootService.mkdirs(indexParentPath).not()) {
             status = STATUS_ERROR
-            info = "Failed to mkdirs: $apkParentPath."
-            LogHelper.e(TAG, "packageAndCompressApk", info)
+            info = "Failed to mkdirs: $indexParentPath."
+            LogHelper.e(TAG, "storeApk", info)
             return status to info
         }
 
-        val inputArgs = mutableListOf<String>()
-        apkList.forEach {
-            inputArgs.add("-C")
-            inputArgs.add(PathHelper.getParentPath(it))
-            inputArgs.add(PathHelper.getChildPath(it))
-        }
-        ZstdHelper.packageAndCompress(
-            outputPath = apkPath,
-            callback = object : ICallback.Stub() {
-                override fun onProgress(bytesWritten: Long, speed: Long, progress: Float) {
-                    onProgress(bytesWritten, speed)
+        val contentIds = RemoteRootService.hashFiles(apkList.toTypedArray())
+        val index = StringBuilder()
+        val startTimestamp = System.currentTimeMillis()
+        var bytesWritten = 0L
+        var storedCount = 0
+        apkList.forEachIndexed { i, apkPath ->
+            ensureNotCanceled()
+            val contentId = contentIds.getOrNull(i).orEmpty()
+            if (contentId.isEmpty()) {
+                status = STATUS_ERROR
+                info = "Failed to hash: $apkPath."
+                LogHelper.e(TAG, "storeApk", info)
+                return status to info
+            }
+            val objectPath = PathHelper.getBackupApkStoreFilePath(backupConfig.path, contentId)
+            if (RemoteRootService.exists(objectPath).not()) {
+                if (RemoteRootService.storeObject(apkPath, objectPath, contentId).not()) {
+                    status = STATUS_ERROR
+                    info = "Failed to store $apkPath as $objectPath, or it changed since it was hashed."
+                    LogHelper.e(TAG, "storeApk", info)
+                    return status to info
                 }
-            },
-            inputArgs = inputArgs.toTypedArray()
-        ).also {
-            status = it.first
-            info = it.second
+                bytesWritten += contentId.substringAfterLast('-').toLong()
+                storedCount++
+                val elapsed = (System.currentTimeMillis() - startTimestamp).coerceAtLeast(1)
+                onProgress(bytesWritten, bytesWritten * 1000 / elapsed)
+            }
+            index.append(contentId).append('\t').append(PathHelper.getChildPath(apkPath)).append('\n')
         }
+        if (RemoteRootService.writeText(indexPath, index.toString()).not()) {
+            status = STATUS_ERROR
+            info = "Failed to write the apk index: $indexPath."
+            LogHelper.e(TAG, "storeApk", info)
+            return status to info
+        }
+
+        info = "Stored $storedCount of ${apkList.size} apks, the rest was already in the store."
+        LogHelper.i(TAG, "storeApk", "${app.packageName}: $info")
         return status to info
     }
 
     private suspend fun packageAndCompress(
         inputDir: String,
         outputPath: String,
+        textLevel: Int,
         onProgress: (bytesWritten: Long, speed: Long) -> Unit
     ): Pair<Int, String> {
         var status = STATUS_SUCCESS
@@ -153,19 +234,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             return status to info
         }
 
-        val inputArgs = mutableListOf<String>()
-        inputArgs.add("-C")
-        inputArgs.add(PathHelper.getParentPath(inputDir))
-        inputArgs.add(PathHelper.getChildPath(inputDir))
-        ZstdHelper.packageAndCompress(
-            outputPath = outputPath,
-            callback = object : ICallback.Stub() {
-                override fun onProgress(bytesWritten: Long, speed: Long, progress: Float) {
-                    onProgress(bytesWritten, speed)
-                }
-            },
-            inputArgs = inputArgs.toTypedArray()
-        ).also {
+        packageAndCompressIfChanged(outputPath = outputPath, roots = arrayOf(inputDir), textLevel = textLevel, onProgress = onProgress).also {
             status = it.first
             info = it.second
         }
@@ -177,6 +246,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         return packageAndCompress(
             inputDir = PathHelper.getAppUserDir(app.userId, app.packageName),
             outputPath = PathHelper.getBackupAppsUserFilePath(backupConfig.path, app.packageName),
+            textLevel = mIntDataTextLevel,
             onProgress = onProgress,
         )
     }
@@ -186,6 +256,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         return packageAndCompress(
             inputDir = PathHelper.getAppUserDeDir(app.userId, app.packageName),
             outputPath = PathHelper.getBackupAppsUserDeFilePath(backupConfig.path, app.packageName),
+            textLevel = mIntDataTextLevel,
             onProgress = onProgress,
         )
     }
@@ -195,6 +266,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         return packageAndCompress(
             inputDir = PathHelper.getAppDataDir(app.userId, app.packageName),
             outputPath = PathHelper.getBackupAppsDataFilePath(backupConfig.path, app.packageName),
+            textLevel = mExtDataTextLevel,
             onProgress = onProgress,
         )
     }
@@ -204,6 +276,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         return packageAndCompress(
             inputDir = PathHelper.getAppObbDir(app.userId, app.packageName),
             outputPath = PathHelper.getBackupAppsObbFilePath(backupConfig.path, app.packageName),
+            textLevel = mExtDataTextLevel,
             onProgress = onProgress,
         )
     }
@@ -213,6 +286,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         return packageAndCompress(
             inputDir = PathHelper.getAppMediaDir(app.userId, app.packageName),
             outputPath = PathHelper.getBackupAppsMediaFilePath(backupConfig.path, app.packageName),
+            textLevel = mExtDataTextLevel,
             onProgress = onProgress,
         )
     }
@@ -221,10 +295,13 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         app: App,
         onProgress: (index: Int, bytesWritten: Long, speed: Long) -> Unit
     ): List<Pair<Int, String>> {
-        val result = mutableListOf<Pair<Int, String>>()
-        result.add(packageAndCompressUser(app) { bytesWritten, speed -> onProgress.invoke(0, bytesWritten, speed) })
-        result.add(packageAndCompressUserDe(app) { bytesWritten, speed -> onProgress.invoke(1, bytesWritten, speed) })
-        return result
+        // Independent archives, the root service bounds how many tar jobs actually run at once.
+        return coroutineScope {
+            listOf(
+                async { packageAndCompressUser(app) { bytesWritten, speed -> onProgress.invoke(0, bytesWritten, speed) } },
+                async { packageAndCompressUserDe(app) { bytesWritten, speed -> onProgress.invoke(1, bytesWritten, speed) } },
+            ).awaitAll()
+        }
     }
 
     private suspend fun packageAndCompressExtData(
@@ -240,10 +317,12 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         app: App,
         onProgress: (index: Int, bytesWritten: Long, speed: Long) -> Unit
     ): List<Pair<Int, String>> {
-        val result = mutableListOf<Pair<Int, String>>()
-        result.add(packageAndCompressObb(app) { bytesWritten, speed -> onProgress.invoke(0, bytesWritten, speed) })
-        result.add(packageAndCompressMedia(app) { bytesWritten, speed -> onProgress.invoke(1, bytesWritten, speed) })
-        return result
+        return coroutineScope {
+            listOf(
+                async { packageAndCompressObb(app) { bytesWritten, speed -> onProgress.invoke(0, bytesWritten, speed) } },
+                async { packageAndCompressMedia(app) { bytesWritten, speed -> onProgress.invoke(1, bytesWritten, speed) } },
+            ).awaitAll()
+        }
     }
 
     private fun getCanceledProcessAppItem(app: App): ProcessAppItem {
@@ -284,6 +363,8 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
     }
 
     private data class AppStepState(
+        // Index of the app in the process app items.
+        val itemIndex: Int,
         val totalStepCount: Int,
         var completedStepCount: Int = 0,
         var apkHandled: Boolean = false,
@@ -301,14 +382,14 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
     }
 
-    private fun updateCurrentProcessApp(onUpdate: ProcessAppItem.() -> ProcessAppItem) {
-        mBackupProcessRepo.updateProcessAppItem { onUpdate() }
+    private fun updateProcessApp(state: AppStepState, onUpdate: ProcessAppItem.() -> ProcessAppItem) {
+        mBackupProcessRepo.updateProcessAppItem(state.itemIndex) { onUpdate() }
     }
 
     private suspend fun processApkStep(app: App, state: AppStepState) {
         if (app.option.apk) {
-            packageAndCompressApk(app) { bytesWritten, speed ->
-                updateCurrentProcessApp {
+            storeApk(app) { bytesWritten, speed ->
+                updateProcessApp(state) {
                     val bytesWrittenFormatted = bytesWritten.formatToStorageSize
                     val speedFormatted = speed.formatToStorageSizePerSecond
                     copy {
@@ -322,7 +403,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
                 }
             }.also { (status, info) ->
                 state.completeStep()
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     copy {
                         ProcessAppItem.apkItem.enabled set getEnabledByStatus(status)
                         ProcessAppItem.apkItem.subtitle set getSubtitleByStatus(status, apkItem.subtitle)
@@ -337,7 +418,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }
         } else {
             state.completeStep()
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.apkItem.enabled set false
                     ProcessAppItem.apkItem.subtitle set application.getString(R.string.not_selected)
@@ -351,9 +432,9 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
     private suspend fun processIntDataStep(app: App, state: AppStepState) {
         if (app.option.internalData) {
             packageAndCompressIntData(app) { index, bytesWritten, speed ->
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     val bytesWrittenFormatted = (intDataItem.details.withIndex().sumOf { (i, item) ->
-                        if (i < index) item.bytes else 0
+                        if (i != index) item.bytes else 0
                     } + bytesWritten).formatToStorageSize
                     val speedFormatted = speed.formatToStorageSizePerSecond
                     copy {
@@ -368,7 +449,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }.also { result ->
                 val finalStatus = getFinalStatusByResult(result)
                 state.completeStep()
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     copy {
                         ProcessAppItem.intDataItem.enabled set getEnabledByStatus(finalStatus)
                         ProcessAppItem.intDataItem.subtitle set getSubtitleByStatus(finalStatus, intDataItem.subtitle)
@@ -385,7 +466,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }
         } else {
             state.completeStep()
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.intDataItem.enabled set false
                     ProcessAppItem.intDataItem.subtitle set application.getString(R.string.not_selected)
@@ -399,9 +480,9 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
     private suspend fun processExtDataStep(app: App, state: AppStepState) {
         if (app.option.externalData) {
             packageAndCompressExtData(app) { index, bytesWritten, speed ->
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     val bytesWrittenFormatted = (extDataItem.details.withIndex().sumOf { (i, item) ->
-                        if (i < index) item.bytes else 0
+                        if (i != index) item.bytes else 0
                     } + bytesWritten).formatToStorageSize
                     val speedFormatted = speed.formatToStorageSizePerSecond
                     copy {
@@ -416,7 +497,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }.also { result ->
                 val finalStatus = getFinalStatusByResult(result)
                 state.completeStep()
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     copy {
                         ProcessAppItem.extDataItem.enabled set getEnabledByStatus(finalStatus)
                         ProcessAppItem.extDataItem.subtitle set getSubtitleByStatus(finalStatus, extDataItem.subtitle)
@@ -433,7 +514,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }
         } else {
             state.completeStep()
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.extDataItem.enabled set false
                     ProcessAppItem.extDataItem.subtitle set application.getString(R.string.not_selected)
@@ -447,9 +528,9 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
     private suspend fun processAddlDataStep(app: App, state: AppStepState) {
         if (app.option.additionalData) {
             packageAndCompressAddlData(app) { index, bytesWritten, speed ->
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     val bytesWrittenFormatted = (addlDataItem.details.withIndex().sumOf { (i, item) ->
-                        if (i < index) item.bytes else 0
+                        if (i != index) item.bytes else 0
                     } + bytesWritten).formatToStorageSize
                     val speedFormatted = speed.formatToStorageSizePerSecond
                     copy {
@@ -464,7 +545,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }.also { result ->
                 val finalStatus = getFinalStatusByResult(result)
                 state.completeStep()
-                updateCurrentProcessApp {
+                updateProcessApp(state) {
                     copy {
                         ProcessAppItem.addlDataItem.enabled set getEnabledByStatus(finalStatus)
                         ProcessAppItem.addlDataItem.subtitle set getSubtitleByStatus(finalStatus, addlDataItem.subtitle)
@@ -481,7 +562,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
             }
         } else {
             state.completeStep()
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.addlDataItem.enabled set false
                     ProcessAppItem.addlDataItem.subtitle set application.getString(R.string.not_selected)
@@ -494,7 +575,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
 
     private fun markCurrentAppRemainingStepsCanceled(app: App, state: AppStepState) {
         if (app.option.apk && state.apkHandled.not()) {
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.apkItem.enabled set getEnabledByStatus(STATUS_CANCEL)
                     ProcessAppItem.apkItem.subtitle set getSubtitleByStatus(STATUS_CANCEL, apkItem.subtitle)
@@ -508,7 +589,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
 
         if (app.option.internalData && state.intDataHandled.not()) {
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.intDataItem.enabled set getEnabledByStatus(STATUS_CANCEL)
                     ProcessAppItem.intDataItem.subtitle set getSubtitleByStatus(STATUS_CANCEL, intDataItem.subtitle)
@@ -526,7 +607,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
 
         if (app.option.externalData && state.extDataHandled.not()) {
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.extDataItem.enabled set getEnabledByStatus(STATUS_CANCEL)
                     ProcessAppItem.extDataItem.subtitle set getSubtitleByStatus(STATUS_CANCEL, extDataItem.subtitle)
@@ -540,7 +621,7 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
 
         if (app.option.additionalData && state.addlDataHandled.not()) {
-            updateCurrentProcessApp {
+            updateProcessApp(state) {
                 copy {
                     ProcessAppItem.addlDataItem.enabled set getEnabledByStatus(STATUS_CANCEL)
                     ProcessAppItem.addlDataItem.subtitle set getSubtitleByStatus(STATUS_CANCEL, addlDataItem.subtitle)
@@ -558,46 +639,71 @@ class BackupAppsHelper(private val mBackupProcessRepo: BackupProcessRepository)
         }
     }
 
+    private suspend fun backupApp(index: Int, app: App, appCount: Int) {
+        if (mBackupProcessRepo.mIsCanceled) {
+            mBackupProcessRepo.addProcessAppItem(getCanceledProcessAppItem(app))
+            return
+        }
+        mBackupProcessRepo.updateAppsItem {
+            // Workers may get here out of order, the index only moves forward.
+            if (index < currentIndex) return@updateAppsItem this
+            copy {
+                ProcessItem.currentIndex set index
+                ProcessItem.msg set app.info.label
+                ProcessItem.progress set index.toFloat() / appCount
+            }
+        }
+        val itemIndex = mBackupProcessRepo.addProcessAppItem(ProcessAppItem(label = app.info.label, packageName = app.packageName, userId = app.userId))
+        val selectedStepCount = listOf(
+            app.option.apk,
+            app.option.internalData,
+            app.option.externalData,
+            app.option.additionalData,
+        ).count { it }
+        val state = AppStepState(itemIndex = itemIndex, totalStepCount = selectedStepCount)
+
+        try {
+            processApkStep(app, state)
+            state.apkHandled = true
+
+            processIntDataStep(app, state)
+            state.intDataHandled = true
+
+            processExtDataStep(app, state)
+            state.extDataHandled = true
+
+            processAddlDataStep(app, state)
+            state.addlDataHandled = true
+        } catch (e: CancellationException) {
+            markCurrentAppRemainingStepsCanceled(app, state)
+            // Canceled by the user, the apps not started yet are marked as canceled by the workers.
+            if (mBackupProcessRepo.mIsCanceled.not()) throw e
+        }
+    }
+
     suspend fun start() {
         val apps = mBackupProcessRepo.getApps()
-        apps.forEachIndexed { index, app ->
-            ensureNotCanceled()
-            mBackupProcessRepo.updateAppsItem {
-                copy {
-                    ProcessItem.currentIndex set index
-                    ProcessItem.msg set app.info.label
-                    ProcessItem.progress set index.toFloat() / apps.size
-                }
-            }
-            mBackupProcessRepo.addProcessAppItem(ProcessAppItem(label = app.info.label, packageName = app.packageName, userId = app.userId))
-            val selectedStepCount = listOf(
-                app.option.apk,
-                app.option.internalData,
-                app.option.externalData,
-                app.option.additionalData,
-            ).count { it }
-            val state = AppStepState(totalStepCount = selectedStepCount)
-
-            try {
-                processApkStep(app, state)
-                state.apkHandled = true
-
-                processIntDataStep(app, state)
-                state.intDataHandled = true
-
-                processExtDataStep(app, state)
-                state.extDataHandled = true
-
-                processAddlDataStep(app, state)
-                state.addlDataHandled = true
-            } catch (e: CancellationException) {
-                markCurrentAppRemainingStepsCanceled(app, state)
-                apps.drop(index + 1).forEach { pendingApp ->
-                    mBackupProcessRepo.addProcessAppItem(getCanceledProcessAppItem(pendingApp))
+        val maxArchiveJobs = application.readInt(MaxArchiveJobsBackup).first()
+        RemoteRootService.setMaxTarJobs(maxArchiveJobs)
+        mAdaptiveCompression = application.readBoolean(AdaptiveCompressionBackup).first()
+        mIntDataTextLevel = application.readInt(IntDataTextLevelBackup).first()
+        mExtDataTextLevel = application.readInt(ExtDataTextLevelBackup).first()
+
+        // Up to maxArchiveJobs apps are backed up at once, in order, so archives of different apps share the
+        // tar job slots of the root service instead of one app's archives running alone.
+        val nextIndex = AtomicInteger(0)
+        coroutineScope {
+            repeat(maxArchiveJobs.coerceIn(1, apps.size.coerceAtLeast(1))) {
+                launch {
+                    while (true) {
+                        val index = nextIndex.getAndIncrement()
+                        if (index >= apps.size) break
+                        backupApp(index, apps[index], apps.size)
+                    }
                 }
-                throw e
             }
         }
+        ensureNotCanceled()
 
         mBackupProcessRepo.updateAppsItem {
             copy {
@@ -32,7 +32,9 @@ import androidx.datastore.preferences.core.Preferences
 import androidx.lifecycle.compose.collectAsStateWithLifecycle
 import com.xayah.databackup.R
 import com.xayah.databackup.util.readBoolean
+import com.xayah.databackup.util.readInt
 import com.xayah.databackup.util.saveBoolean
+import com.xayah.databackup.util.saveInt
 import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.launch
 
@@ -214,3 +216,46 @@ fun SwitchablePreference(
         }
     }
 }
+
+/**
+ * Shows the current value of [dataStorePair], each click selects the next one of [values] and wraps around after the last.
+ */
+@Composable
+fun CyclablePreference(
+    modifier: Modifier = Modifier,
+    enabled: Boolean = true,
+    icon: ImageVector,
+    title: String,
+    subtitle: String,
+    values: List<Int>,
+    containerColor: Color = MaterialTheme.colorScheme.surfaceContainer,
+    dataStorePair: Pair<Preferences.Key<Int>, Int>,
+) {
+    val context = LocalContext.current
+    val scope = rememberCoroutineScope()
+    val value by context.readInt(dataStorePair).collectAsStateWithLifecycle(initialValue = dataStorePair.second)
+    val animatedValueColor by animateColorAsState(
+        targetValue = if (enabled) MaterialTheme.colorScheme.primary else MaterialTheme.colorScheme.primary.copy(alpha = DisabledOpacity),
+        label = "animatedColor"
+    )
+
+    Preference(
+        modifier = modifier,
+        enabled = enabled,
+        icon = icon,
+        title = title,
+        subtitle = subtitle,
+        containerColor = containerColor,
+        slot = {
+            Text(
+                text = value.toString(),
+                style = MaterialTheme.typography.titleMedium,
+                color = animatedValueColor
+            )
+        }
+    ) {
+        scope.launch(Dispatchers.Default) {
+            context.saveInt(dataStorePair.first, values.firstOrNull { it > value } ?: values.first())
+        }
+    }
+}
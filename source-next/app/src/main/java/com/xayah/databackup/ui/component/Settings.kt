@@ -1,12 +1,27 @@
 package com.xayah.databackup.ui.component
 
 import androidx.compose.runtime.Composable
+import androidx.compose.runtime.getValue
 import androidx.compose.ui.graphics.vector.ImageVector
+import androidx.compose.ui.platform.LocalContext
 import androidx.compose.ui.res.stringResource
 import androidx.compose.ui.res.vectorResource
+import androidx.lifecycle.compose.collectAsStateWithLifecycle
 import com.xayah.databackup.R
+import com.xayah.databackup.util.AdaptiveCompressionBackup
 import com.xayah.databackup.util.AutoScreenOff
+import com.xayah.databackup.util.ExtDataTextLevelBackup
+import com.xayah.databackup.util.IntDataTextLevelBackup
+import com.xayah.databackup.util.MaxArchiveJobsBackup
+import com.xayah.databackup.util.NativeTracingBackup
 import com.xayah.databackup.util.ResetBackupList
+import com.xayah.databackup.util.readBoolean
+
+// zstd levels offered for text and databases, above the default level of the archives.
+private val TextLevels = listOf(3, 6, 9, 12, 15, 19)
+
+// Apps archived at once, their zstd workers share the cores.
+private val ArchiveJobs = listOf(1, 2, 3, 4)
 
 @Composable
 fun AutoScreenOffSwitch() {
@@ -28,3 +43,62 @@ fun ResetBackupListSwitch() {
         dataStorePair = ResetBackupList
     )
 }
+
+@Composable
+fun NativeTracingSwitch() {
+    SwitchablePreference(
+        icon = ImageVector.vectorResource(R.drawable.ic_gauge),
+        title = stringResource(R.string.native_tracing),
+        subtitle = stringResource(R.string.native_tracing_desc),
+        dataStorePair = NativeTracingBackup
+    )
+}
+
+@Composable
+fun AdaptiveCompressionSwitch() {
+    SwitchablePreference(
+        icon = ImageVector.vectorResource(R.drawable.ic_folder_archive),
+        title = stringResource(R.string.adaptive_compression),
+        subtitle = stringResource(R.string.adaptive_compression_desc),
+        dataStorePair = AdaptiveCompressionBackup
+    )
+}
+
+@Composable
+fun IntDataTextLevelPreference() {
+    val context = LocalContext.current
+    val adaptive by context.readBoolean(AdaptiveCompressionBackup).collectAsStateWithLifecycle(initialValue = AdaptiveCompressionBackup.second)
+    CyclablePreference(
+        enabled = adaptive,
+        icon = ImageVector.vectorResource(R.drawable.ic_database),
+        title = stringResource(R.string.int_data_text_level),
+        subtitle = stringResource(R.string.int_data_text_level_desc),
+        values = TextLevels,
+        dataStorePair = IntDataTextLevelBackup
+    )
+}
+
+@Composable
+fun ExtDataTextLevelPreference() {
+    val context = LocalContext.current
+    val adaptive by context.readBoolean(AdaptiveCompressionBackup).collectAsStateWithLifecycle(initialValue = AdaptiveCompressionBackup.second)
+    CyclablePreference(
+        enabled = adaptive,
+        icon = ImageVector.vectorResource(R.drawable.ic_book_text),
+        title = stringResource(R.string.ext_data_text_level),
+        subtitle = stringResource(R.string.ext_data_text_level_desc),
+        values = TextLevels,
+        dataStorePair = ExtDataTextLevelBackup
+    )
+}
+
+@Composable
+fun MaxArchiveJobsPreference() {
+    CyclablePreference(
+        icon = ImageVector.vectorResource(R.drawable.ic_cpu),
+        title = stringResource(R.string.max_archive_jobs),
+        subtitle = stringResource(R.string.max_archive_jobs_desc),
+        values = ArchiveJobs,
+        dataStorePair = MaxArchiveJobsBackup
+    )
+}
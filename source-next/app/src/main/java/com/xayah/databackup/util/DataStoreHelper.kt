@@ -115,3 +115,23 @@ val MessagesOptionSelectedBackup = Pair(KeyMessagesOptionSelectedBackup, DefMess
 val KeyBackupConfigSelectedUuid = stringPreferencesKey("backup_config_selected_uuid")
 const val DefBackupConfigSelectedUuid = ""
 val BackupConfigSelectedUuid = Pair(KeyBackupConfigSelectedUuid, DefBackupConfigSelectedUuid)
+
+val KeyMaxArchiveJobsBackup = intPreferencesKey("max_archive_jobs_backup")
+const val DefMaxArchiveJobsBackup = 2
+val MaxArchiveJobsBackup = Pair(KeyMaxArchiveJobsBackup, DefMaxArchiveJobsBackup)
+
+val KeyAdaptiveCompressionBackup = booleanPreferencesKey("adaptive_compression_backup")
+const val DefAdaptiveCompressionBackup = true
+val AdaptiveCompressionBackup = Pair(KeyAdaptiveCompressionBackup, DefAdaptiveCompressionBackup)
+
+val KeyIntDataTextLevelBackup = intPreferencesKey("int_data_text_level_backup")
+const val DefIntDataTextLevelBackup = 6
+val IntDataTextLevelBackup = Pair(KeyIntDataTextLevelBackup, DefIntDataTextLevelBackup)
+
+val KeyExtDataTextLevelBackup = intPreferencesKey("ext_data_text_level_backup")
+const val DefExtDataTextLevelBackup = 3
+val ExtDataTextLevelBackup = Pair(KeyExtDataTextLevelBackup, DefExtDataTextLevelBackup)
+
+val KeyNativeTracingBackup = booleanPreferencesKey("native_tracing_backup")
+const val DefNativeTracingBackup = false
+val NativeTracingBackup = Pair(KeyNativeTracingBackup, DefNativeTracingBackup)
@@ -0,0 +1,56 @@
+package com.xayah.databackup.util
+
+import com.xayah.databackup.App
+import com.xayah.databackup.rootservice.RemoteRootService
+import kotlinx.coroutines.NonCancellable
+import kotlinx.coroutines.flow.first
+import kotlinx.coroutines.sync.Mutex
+import kotlinx.coroutines.sync.withLock
+import kotlinx.coroutines.withContext
+
+/**
+ * Scopes the native counters and spans of the root service to one backup or restore run.
+ */
+object NativeTraceHelper {
+    private const val TAG = "NativeTraceHelper"
+
+    private val mMutex = Mutex()
+    private var mRuns = 0
+    private var mTracing = false
+
+    /**
+     * Runs [block] as a [run] of its own: resets the native counters, records spans if [NativeTracingBackup]
+     * is enabled, then logs the counters and dumps the spans for bug reports. Runs that overlap share one trace,
+     * which is written when the last of them finishes.
+     */
+    suspend fun <T> traced(run: String, block: suspend () -> T): T {
+        mMutex.withLock {
+            if (mRuns++ == 0) {
+                mTracing = App.application.readBoolean(NativeTracingBackup).first()
+                RemoteRootService.resetNativeTrace()
+                RemoteRootService.setNativeTraceEnabled(mTracing)
+            }
+        }
+        try {
+            return block()
+        } finally {
+            withContext(NonCancellable) {
+                mMutex.withLock {
+                    if (--mRuns == 0) finish(run)
+                }
+            }
+        }
+    }
+
+    private suspend fun finish(run: String) {
+        LogHelper.i(TAG, "finish", "Native counters of $run: ${RemoteRootService.readNativeTraceCounters()}")
+        if (mTracing.not()) return
+        RemoteRootService.setNativeTraceEnabled(false)
+        val tracePath = PathHelper.getNativeTraceFilePath(run, System.currentTimeMillis())
+        if (RemoteRootService.mkdirs(PathHelper.getParentPath(tracePath)) && RemoteRootService.dumpNativeTrace(tracePath)) {
+            LogHelper.i(TAG, "finish", "Native trace written to $tracePath.")
+        } else {
+            LogHelper.w(TAG, "finish", "Failed to write the native trace to $tracePath.")
+        }
+    }
+}
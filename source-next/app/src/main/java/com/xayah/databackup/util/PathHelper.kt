@@ -16,6 +16,7 @@ object PathHelper {
     private const val SUBDIR_BACKUPS = "backups"
     private const val SUBDIR_APPS = "apps"
     private const val SUBDIR_APK = "apk"
+    private const val SUBDIR_APK_STORE = "apk_store"
     private const val SUBDIR_INT_DATA = "int_data"
     private const val SUBDIR_EXT_DATA = "ext_data"
     private const val SUBDIR_ADDL_DATA = "addl_data"
@@ -26,10 +27,13 @@ object PathHelper {
     private const val SUBDIR_APP_PARTS = "app_parts"
     private const val SUBDIR_REPO = "repo"
     private const val SUBDIR_RUSTIC = "rustic"
+    private const val SUBDIR_TRACES = "traces"
 
     private const val CONFIG_FILE_SUFFIX = ".config"
+    private const val MANIFEST_FILE_SUFFIX = ".manifest"
 
-    private const val APK_FILE_NAME = "apk.tar.zst"
+    private const val APK_INDEX_FILE_NAME = "apk.index"
+    private const val APK_OBJECT_SUFFIX = ".apk"
     private const val USER_FILE_NAME = "user.tar.zst"
     private const val USER_DE_FILE_NAME = "user_de.tar.zst"
     private const val DATA_FILE_NAME = "data.tar.zst"
@@ -76,9 +80,17 @@ object PathHelper {
     fun getBackupRepoDir(parent: String): String = "$parent/$SUBDIR_REPO"
     fun getRusticStagingDir(configUuid: String, createdAt: Long): String =
         "${App.application.cacheDir.path}/$SUBDIR_RUSTIC/$configUuid/$createdAt"
+    fun getNativeTraceFilePath(run: String, createdAt: Long): String =
+        "${App.application.cacheDir.path}/$SUBDIR_TRACES/${run}_$createdAt.json"
 
-    fun getBackupAppsApkFilePath(parent: String, packageName: String): String =
-        "${getBackupAppsApkDir(parent, packageName)}/$APK_FILE_NAME"
+    fun getBackupAppsApkIndexFilePath(parent: String, packageName: String): String =
+        "${getBackupAppsApkDir(parent, packageName)}/$APK_INDEX_FILE_NAME"
+
+    /**
+     * Apks of all apps, users and backup runs share one store, objects are named by their content id.
+     */
+    fun getBackupApkStoreFilePath(parent: String, contentId: String): String =
+        "$parent/$SUBDIR_APK_STORE/$contentId$APK_OBJECT_SUFFIX"
 
     fun getBackupAppsUserFilePath(parent: String, packageName: String): String =
         "${getBackupAppsIntDataDir(parent, packageName)}/$USER_FILE_NAME"
@@ -95,6 +107,8 @@ object PathHelper {
     fun getBackupAppsMediaFilePath(parent: String, packageName: String): String =
         "${getBackupAppsAddlDataDir(parent, packageName)}/$MEDIA_FILE_NAME"
 
+    fun getManifestFilePath(archivePath: String): String = "$archivePath$MANIFEST_FILE_SUFFIX"
+
     fun getBackupNetworksConfigFileRelativePath(): String = "$SUBDIR_NETWORKS/$NETWORKS_FILE_NAME"
     fun getBackupContactsConfigFileRelativePath(): String = "$SUBDIR_CONTACTS/$CONTACTS_FILE_NAME"
     fun getBackupCallLogsConfigFileRelativePath(): String = "$SUBDIR_CALL_LOGS/$CALL_LOGS_FILE_NAME"
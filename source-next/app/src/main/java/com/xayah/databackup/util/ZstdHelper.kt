@@ -1,12 +1,17 @@
 package com.xayah.databackup.util
 
 import android.system.Os
+import android.system.OsConstants
 import com.xayah.databackup.App
+import com.xayah.databackup.data.STATUS_CANCEL
 import com.xayah.databackup.rootservice.ICallback
 import com.xayah.databackup.rootservice.RemoteRootService
 import com.xayah.databackup.util.PathHelper.TMP_FIFO_PREFIX
 import com.xayah.databackup.util.PathHelper.TMP_SUFFIX
+import com.xayah.libnative.TarWrapper
+import kotlinx.coroutines.CancellationException
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.NonCancellable
 import kotlinx.coroutines.async
 import kotlinx.coroutines.withContext
 import java.io.File
@@ -15,14 +20,45 @@ import java.io.FileInputStream
 object ZstdHelper {
     const val TAG = "ZstdHelper"
 
-    suspend fun packageAndCompress(outputPath: String, callback: ICallback? = null, vararg inputArgs: String): Pair<Int, String> {
-        val args = mutableListOf("tar", "-cpf", "-")
+    private const val COMPRESSION_LEVEL = 1
+    // Used for media and archives in adaptive mode, negative levels leave literals uncompressed.
+    private const val FAST_COMPRESSION_LEVEL = -5
+    private const val JOB_WAIT_INTERVAL_MS = 1000L
+
+    /**
+     * Waits for a tar job of the root service, the job is canceled if the calling coroutine is.
+     * Returns the tar exit code, [STATUS_CANCEL] or -1.
+     */
+    suspend fun awaitTarJob(job: Long): Int {
+        if (job == -1L) return -1
+        try {
+            while (true) {
+                val status = RemoteRootService.waitTarJob(job, JOB_WAIT_INTERVAL_MS)
+                return when (status) {
+                    TarWrapper.JOB_RUNNING -> continue
+                    TarWrapper.JOB_CANCELED -> STATUS_CANCEL
+                    // Released or never known to the root service, e.g. it restarted.
+                    TarWrapper.JOB_UNKNOWN -> -1
+                    else -> status
+                }
+            }
+        } catch (e: CancellationException) {
+            withContext(NonCancellable) {
+                RemoteRootService.cancelTarJob(job)
+                RemoteRootService.waitTarJob(job, -1)
+            }
+            throw e
+        }
+    }
+
+    /**
+     * Runs a native tar call in the root service while collecting its std err through a FIFO.
+     * Cancellation of the calling coroutine is rethrown once the call returned.
+     */
+    private suspend fun callWithStdErr(functionName: String, call: suspend (stdErr: String) -> Int): Pair<Int, String> {
         var status = 0
         var info = ""
 
-        val stdOut = File.createTempFile(TMP_FIFO_PREFIX, TMP_SUFFIX, App.application.cacheDir)
-        stdOut.delete()
-        Os.mkfifo(stdOut.path, 420)
         val stdErr = File.createTempFile(TMP_FIFO_PREFIX, TMP_SUFFIX, App.application.cacheDir)
         stdErr.delete()
         Os.mkfifo(stdErr.path, 420)
@@ -37,7 +73,7 @@ object ZstdHelper {
                         }
                     }.onFailure {
                         val msg = "Failed to get std err."
-                        LogHelper.e(TAG, "packageAndCompress#getStdErr", msg, it)
+                        LogHelper.e(TAG, "$functionName#getStdErr", msg, it)
                         ShellHelper.killRootService()
                         status = -1
                         info = msg
@@ -45,43 +81,17 @@ object ZstdHelper {
                     }
                 }
 
-                val getStdOut = async(Dispatchers.IO) {
-                    var result: String? = null
-                    var tr: Throwable? = null
-                    runCatching {
-                        result = RemoteRootService.compress(1, stdOut.path, outputPath, callback)
-                    }.onFailure {
-                        val msg = "Failed to get std out."
-                        result = msg
-                        tr = it
-                    }
-                    if (result != null) {
-                        LogHelper.e(TAG, "packageAndCompress#getStdOut", result, tr)
-                        ShellHelper.killRootService()
-                        status = -1
-                        info = result
-
-                        /**
-                         * Use shell instead of root service to remove broken file, 'cause root service may failed to connect
-                         */
-                        ShellHelper.rm(outputPath)
-                        RemoteRootService.checkENOSPC("$result, ${tr?.message}")
-
-                        throw IllegalStateException()
-                    }
-                }
-
-                val callTarCli = async(Dispatchers.IO) {
+                val callNative = async(Dispatchers.IO) {
                     runCatching {
-                        args.addAll(inputArgs)
-                        status = RemoteRootService.callTarCli(
-                            stdOut = stdOut.path,
-                            stdErr = stdErr.path,
-                            argv = args.toTypedArray()
-                        )
+                        status = call(stdErr.path)
                     }.onFailure {
-                        val msg = "Failed to call tar cli."
-                        LogHelper.e(TAG, "packageAndCompress#callTarCli", msg, it)
+                        if (it is CancellationException) {
+                            // Unblocks getStdErr if the root service never opened the FIFO, fails without a reader.
+                            runCatching { Os.close(Os.open(stdErr.path, OsConstants.O_WRONLY or OsConstants.O_NONBLOCK, 0)) }
+                            throw it
+                        }
+                        val msg = "Failed to call native tar."
+                        LogHelper.e(TAG, "$functionName#callNative", msg, it)
                         ShellHelper.killRootService()
                         status = -1
                         info = msg
@@ -90,18 +100,70 @@ object ZstdHelper {
                 }
 
                 getStdErr.await()
-                getStdOut.await()
-                callTarCli.await()
+                callNative.await()
             }
         }.onFailure {
-            LogHelper.i(TAG, "packageAndCompress", "Failed to package, remove the target file: $outputPath")
-            RemoteRootService.deleteRecursively(outputPath)
+            if (it is CancellationException) {
+                stdErr.delete()
+                throw it
+            }
         }
 
-        stdOut.delete()
         stdErr.delete()
+        return status to info
+    }
+
+    /**
+     * Describes how [packageAndCompress] writes an archive, two archives of the same files only match if this does.
+     */
+    fun archiveSettings(adaptive: Boolean, textLevel: Int): String = if (adaptive) {
+        "zstd:$COMPRESSION_LEVEL:adaptive:$FAST_COMPRESSION_LEVEL:$textLevel"
+    } else {
+        "zstd:$COMPRESSION_LEVEL"
+    }
+
+    /**
+     * Archives [roots] into a zstd compressed tar at [outputPath], both steps run natively in the root service.
+     * If [adaptive], large already compressed files are stored with a fast level and large text files and
+     * databases compressed with [textLevel].
+     */
+    suspend fun packageAndCompress(
+        outputPath: String,
+        callback: ICallback? = null,
+        adaptive: Boolean = false,
+        textLevel: Int = COMPRESSION_LEVEL,
+        vararg roots: String
+    ): Pair<Int, String> {
+        val (status, info) = try {
+            callWithStdErr("packageAndCompress") { stdErr ->
+                val job = RemoteRootService.startArchive(
+                    stdErr = stdErr,
+                    roots = arrayOf(*roots),
+                    outputPath = outputPath,
+                    level = COMPRESSION_LEVEL,
+                    adaptive = adaptive,
+                    fastLevel = FAST_COMPRESSION_LEVEL,
+                    textLevel = textLevel,
+                    callback = callback
+                )
+                awaitTarJob(job)
+            }
+        } catch (e: CancellationException) {
+            withContext(NonCancellable) {
+                LogHelper.i(TAG, "packageAndCompress", "Canceled, remove the target file: $outputPath")
+                RemoteRootService.deleteRecursively(outputPath)
+            }
+            throw e
+        }
+
+        // -1 means the root service died or compression/writing failed natively, details are in std err.
+        if (status == -1 || status == STATUS_CANCEL) {
+            RemoteRootService.checkENOSPC(info)
+            LogHelper.i(TAG, "packageAndCompress", "Failed to package, remove the target file: $outputPath")
+            RemoteRootService.deleteRecursively(outputPath)
+        }
 
-        LogHelper.i(TAG, "packageAndCompress", "args:\n$args\nstatus: $status\ninfo:\n$info")
+        LogHelper.i(TAG, "packageAndCompress", "roots:\n${roots.toList()}\nstatus: $status\ninfo:\n$info")
 
         return status to info
     }
@@ -0,0 +1,485 @@
+/**
+ * Host benchmark of the native backup engines, built with -DNATIVE_HOST_BENCHMARK=ON.
+ *
+ * Generates a synthetic tree shaped like app data (many small shared_prefs and SQLite
+ * files, deep cache hierarchies, large media blobs), then measures the tree walk, the
+ * vendored tar archiving into a pipe and the tar.zst pipeline at several levels and
+ * worker counts. Results are written as JSON so runs can be compared across commits.
+ *
+ * rustic runs as a separate cargo example (rustic/examples/benchmark.rs) on the same
+ * tree, its JSON output is embedded under "rustic".
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "nativelib.h"
+#include "sha256.h"
+#include "tar-archive.h"
+#include "trace.h"
+
+namespace {
+    struct Config {
+        std::string output;
+        std::string work_dir = "/tmp";
+        int scale = 1;
+        int repeat = 3;
+        std::vector<int> levels = {1, 3, 9};
+        std::vector<int> workers = {0, 2, 4};
+        std::string rustic;
+        bool keep = false;
+    };
+
+    struct TreeStats {
+        uint64_t files = 0;
+        uint64_t dirs = 0;
+        uint64_t bytes = 0;
+    };
+
+    struct Result {
+        std::string name;
+        std::string params;
+        std::vector<double> seconds;
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+    };
+
+    // splitmix64, the tree has to be identical on every run and every host.
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : mState(seed) {}
+
+        uint64_t next() {
+            uint64_t z = (mState += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        uint64_t below(uint64_t bound) {
+            return next() % bound;
+        }
+
+    private:
+        uint64_t mState;
+    };
+
+    const char *const WORDS[] = {
+            "true", "false", "name", "value", "string", "int", "long", "boolean", "last_sync", "token",
+            "user_id", "enabled", "theme", "dark", "locale", "en_US", "timestamp", "version", "cache", "count",
+    };
+
+    bool write_file(const std::string &path, const std::string &content, TreeStats &stats) {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1) {
+            fprintf(stderr, "Failed to create '%s': %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        size_t offset = 0;
+        while (offset < content.size()) {
+            ssize_t written = write(fd, content.data() + offset, content.size() - offset);
+            if (written == -1) {
+                if (errno == EINTR) continue;
+                fprintf(stderr, "Failed to write '%s': %s\n", path.c_str(), strerror(errno));
+                close(fd);
+                return false;
+            }
+            offset += written;
+        }
+        close(fd);
+        stats.files++;
+        stats.bytes += content.size();
+        return true;
+    }
+
+    bool make_dir(const std::string &path, TreeStats &stats) {
+        if (mkdir(path.c_str(), 0755) == -1 && errno != EEXIST) {
+            fprintf(stderr, "Failed to create '%s': %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        stats.dirs++;
+        return true;
+    }
+
+    std::string shared_prefs(Random &random) {
+        std::string xml = "<?xml version='1.0' encoding='utf-8' standalone='yes' ?>\n<map>\n";
+        size_t entries = 20 + random.below(80);
+        for (size_t i = 0; i < entries; i++) {
+            const char *key = WORDS[random.below(std::size(WORDS))];
+            xml += "    <string name=\"";
+            xml += key;
+            xml += "_" + std::to_string(i) + "\">";
+            xml += WORDS[random.below(std::size(WORDS))];
+            xml += std::to_string(random.below(1000000)) + "</string>\n";
+        }
+        xml += "</map>\n";
+        return xml;
+    }
+
+    // Pages of short repetitive records with some random ids, compresses about like real databases.
+    std::string sqlite_database(Random &random, size_t size) {
+        std::string db("SQLite format 3\0", 16);
+        db.resize(4096, '\0');
+        while (db.size() < size) {
+            std::string page;
+            page.reserve(4096);
+            while (page.size() < 4096 - 64) {
+                char record[64];
+                snprintf(record, sizeof(record), "%s|%016" PRIx64 "|%s;",
+                         WORDS[random.below(std::size(WORDS))], random.next(), WORDS[random.below(std::size(WORDS))]);
+                page += record;
+            }
+            page.resize(4096, '\0');
+            db += page;
+        }
+        db.resize(size);
+        return db;
+    }
+
+    std::string media_blob(Random &random, size_t size) {
+        std::string blob;
+        blob.resize(size);
+        for (size_t i = 0; i + 8 <= size; i += 8) {
+            uint64_t value = random.next();
+            memcpy(&blob[i], &value, sizeof(value));
+        }
+        // JPEG magic, the adaptive mode classifies it as already compressed.
+        memcpy(&blob[0], "\xff\xd8\xff\xe0", 4);
+        return blob;
+    }
+
+    bool generate_app(const std::string &root, int index, TreeStats &stats) {
+        Random random(0x5eed + index);
+        std::string app = root + "/com.example.app" + std::to_string(index);
+        if (!make_dir(app, stats)) return false;
+
+        if (!make_dir(app + "/shared_prefs", stats)) return false;
+        for (int i = 0; i < 40; i++) {
+            if (!write_file(app + "/shared_prefs/prefs_" + std::to_string(i) + ".xml", shared_prefs(random), stats)) return false;
+        }
+
+        if (!make_dir(app + "/databases", stats)) return false;
+        for (int i = 0; i < 4; i++) {
+            size_t size = (256 + random.below(1792)) * 1024;
+            std::string name = app + "/databases/db_" + std::to_string(i);
+            if (!write_file(name + ".db", sqlite_database(random, size), stats)) return false;
+            if (!write_file(name + ".db-journal", std::string(512, '\0'), stats)) return false;
+        }
+
+        // Deep cache hierarchy of tiny files, stresses the walk and tar headers.
+        std::string dir = app + "/cache";
+        for (int depth = 0; depth < 12; depth++) {
+            if (!make_dir(dir, stats)) return false;
+            for (int i = 0; i < 8; i++) {
+                std::string content(64 + random.below(960), 'c');
+                if (!write_file(dir + "/entry_" + std::to_string(i), content, stats)) return false;
+            }
+            dir += "/d" + std::to_string(depth);
+        }
+
+        if (!make_dir(app + "/files", stats)) return false;
+        for (int i = 0; i < 2; i++) {
+            size_t size = (4 + random.below(12)) * 1024 * 1024;
+            if (!write_file(app + "/files/media_" + std::to_string(i) + ".jpg", media_blob(random, size), stats)) return false;
+        }
+        return true;
+    }
+
+    bool remove_tree(const std::string &path) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execlp("rm", "rm", "-rf", path.c_str(), nullptr);
+            _exit(127);
+        }
+        int status = 0;
+        return pid != -1 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    double now_seconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        size_t mid = values.size() / 2;
+        return values.size() % 2 == 1 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+    }
+
+    /**
+     * Runs `body` `repeat` times, `body` returns false on failure and reports the bytes it moved.
+     */
+    bool measure(Result &result, int repeat, const std::function<bool(uint64_t &, uint64_t &)> &body) {
+        for (int i = 0; i < repeat; i++) {
+            uint64_t bytes_in = 0;
+            uint64_t bytes_out = 0;
+            double start = now_seconds();
+            if (!body(bytes_in, bytes_out)) {
+                fprintf(stderr, "%s (%s) failed.\n", result.name.c_str(), result.params.c_str());
+                return false;
+            }
+            result.seconds.push_back(now_seconds() - start);
+            result.bytes_in = bytes_in;
+            result.bytes_out = bytes_out;
+        }
+        return true;
+    }
+
+    uint64_t trace_counter(const std::string &counters, const char *name) {
+        std::string key = std::string("\"") + name + "\":";
+        size_t pos = counters.find(key);
+        return pos == std::string::npos ? 0 : strtoull(counters.c_str() + pos + key.size(), nullptr, 10);
+    }
+
+    std::vector<std::string> tar_args(const std::string &root) {
+        size_t slash = root.find_last_of('/');
+        return {"tar", "-cpf", "-", "-C", root.substr(0, slash), root.substr(slash + 1)};
+    }
+
+    std::string run_rustic(const Config &config, const std::string &tree, const std::string &work) {
+        if (config.rustic.empty() || access(config.rustic.c_str(), X_OK) != 0) {
+            fprintf(stderr, "rustic benchmark '%s' not found, skipped.\n", config.rustic.c_str());
+            return "null";
+        }
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) return "null";
+        pid_t pid = fork();
+        if (pid == 0) {
+            dup2(fds[1], STDOUT_FILENO);
+            execl(config.rustic.c_str(), config.rustic.c_str(), tree.c_str(), work.c_str(),
+                  std::to_string(config.repeat).c_str(), nullptr);
+            _exit(127);
+        }
+        close(fds[1]);
+        std::string output;
+        char buffer[4096];
+        ssize_t nread;
+        while ((nread = read(fds[0], buffer, sizeof(buffer))) > 0 || (nread == -1 && errno == EINTR)) {
+            if (nread > 0) output.append(buffer, nread);
+        }
+        close(fds[0]);
+        int status = 0;
+        if (pid == -1 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || output.empty()) {
+            fprintf(stderr, "rustic benchmark failed.\n");
+            return "null";
+        }
+        while (!output.empty() && (output.back() == '\n' || output.back() == ' ')) output.pop_back();
+        return output;
+    }
+
+    std::vector<int> parse_list(const char *value) {
+        std::vector<int> list;
+        for (const char *p = value; *p != '\0';) {
+            char *end;
+            list.push_back(static_cast<int>(strtol(p, &end, 10)));
+            p = *end == ',' ? end + 1 : end;
+            if (end == p && *p != '\0') break;
+        }
+        return list;
+    }
+
+    void usage(const char *name) {
+        fprintf(stderr,
+                "Usage: %s [--output FILE] [--work-dir DIR] [--scale N] [--repeat N]\n"
+                "          [--levels 1,3,9] [--workers 0,2,4] [--rustic BINARY] [--keep]\n"
+                "The tree is generated in a new native-benchmark-XXXXXX directory inside DIR (default /tmp),\n"
+                "only that directory is removed afterwards.\n",
+                name);
+    }
+
+    bool parse_args(int argc, char **argv, Config &config) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--keep") {
+                config.keep = true;
+            } else if (arg == "--output" && has_value) {
+                config.output = argv[++i];
+            } else if (arg == "--work-dir" && has_value) {
+                config.work_dir = argv[++i];
+            } else if (arg == "--scale" && has_value) {
+                config.scale = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--repeat" && has_value) {
+                config.repeat = std::max(1, atoi(argv[++i]));
+            } else if (arg == "--levels" && has_value) {
+                config.levels = parse_list(argv[++i]);
+            } else if (arg == "--workers" && has_value) {
+                config.workers = parse_list(argv[++i]);
+            } else if (arg == "--rustic" && has_value) {
+                config.rustic = argv[++i];
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void write_json(FILE *file, const Config &config, const TreeStats &stats, const std::vector<Result> &results,
+                    const std::string &counters, const std::string &rustic) {
+        struct utsname host{};
+        uname(&host);
+        fprintf(file, "{\n  \"host\": {\"sysname\": \"%s\", \"release\": \"%s\", \"machine\": \"%s\", \"cpus\": %u},\n",
+                host.sysname, host.release, host.machine, std::thread::hardware_concurrency());
+        fprintf(file, "  \"config\": {\"scale\": %d, \"repeat\": %d},\n", config.scale, config.repeat);
+        fprintf(file, "  \"tree\": {\"files\": %" PRIu64 ", \"dirs\": %" PRIu64 ", \"bytes\": %" PRIu64 "},\n",
+                stats.files, stats.dirs, stats.bytes);
+        fprintf(file, "  \"results\": [");
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result &result = results[i];
+            fprintf(file, "%s\n    {\"name\": \"%s\", \"params\": {%s}, ", i == 0 ? "" : ",",
+                    result.name.c_str(), result.params.c_str());
+            if (result.seconds.empty()) {
+                // Failed before a timed run completed, report no timings rather than zeros.
+                fprintf(file, "\"median_s\": null, \"min_s\": null, ");
+            } else {
+                fprintf(file, "\"median_s\": %.6f, \"min_s\": %.6f, ", median(result.seconds),
+                        *std::min_element(result.seconds.begin(), result.seconds.end()));
+            }
+            fprintf(file, "\"bytes_in\": %" PRIu64 ", \"bytes_out\": %" PRIu64 ", ", result.bytes_in, result.bytes_out);
+            double seconds = result.seconds.empty() ? 0 : median(result.seconds);
+            if (seconds > 0) {
+                fprintf(file, "\"mib_per_s\": %.2f, ", static_cast<double>(result.bytes_in) / seconds / (1024 * 1024));
+            } else {
+                fprintf(file, "\"mib_per_s\": null, ");
+            }
+            fprintf(file, "\"ratio\": %.4f}",
+                    result.bytes_in > 0 ? static_cast<double>(result.bytes_out) / static_cast<double>(result.bytes_in) : 0.0);
+        }
+        fprintf(file, "\n  ],\n  \"counters\": %s,\n  \"rustic\": %s\n}\n", counters.c_str(), rustic.c_str());
+    }
+}
+
+int main(int argc, char **argv) {
+    Config config;
+#ifdef RUSTIC_BENCHMARK_PATH
+    config.rustic = RUSTIC_BENCHMARK_PATH;
+#endif
+    if (!parse_args(argc, argv, config)) {
+        usage(argv[0]);
+        return 2;
+    }
+    // Object names of the apk store depend on it, a wrong digest must not go unnoticed in a result.
+    if (!NativeNS::Sha256::self_test()) {
+        fprintf(stderr, "SHA-256 failed its known answer test.\n");
+        return 1;
+    }
+
+    // DIR may hold unrelated files, only the directory created in it is removed at the end.
+    if (mkdir(config.work_dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create '%s': %s\n", config.work_dir.c_str(), strerror(errno));
+        return 1;
+    }
+    std::string pattern = config.work_dir + "/native-benchmark-XXXXXX";
+    if (mkdtemp(pattern.data()) == nullptr) {
+        fprintf(stderr, "mkdtemp in '%s' failed: %s\n", config.work_dir.c_str(), strerror(errno));
+        return 1;
+    }
+    std::string work = pattern;
+    std::string tree = work + "/data";
+
+    TreeStats stats;
+    if (!make_dir(tree, stats)) return 1;
+    for (int i = 0; i < 8 * config.scale; i++) {
+        if (!generate_app(tree, i, stats)) return 1;
+    }
+    fprintf(stderr, "Generated %" PRIu64 " files, %" PRIu64 " dirs, %" PRIu64 " bytes in '%s'.\n",
+            stats.files, stats.dirs, stats.bytes, tree.c_str());
+
+    int dev_null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (dev_null == -1) return 1;
+    std::vector<Result> results;
+    bool ok = true;
+
+    {
+        Result result{"calculate_tree_size", "", {}, 0, 0};
+        // The first walk warms the dentry cache, like the size pass before a real backup.
+        ok &= measure(result, config.repeat + 1, [&](uint64_t &bytes_in, uint64_t &) {
+            int64_t size = 0;
+            if (NativeNS::calculate_tree_size(tree, &size) != 0) return false;
+            bytes_in = static_cast<uint64_t>(size);
+            return true;
+        });
+        if (!result.seconds.empty()) result.seconds.erase(result.seconds.begin());
+        results.push_back(result);
+    }
+
+    {
+        // GNU tar skips reading file contents when writing to /dev/null, drain a pipe instead.
+        Result result{"tar", "\"output\": \"pipe\"", {}, 0, 0};
+        ok &= measure(result, config.repeat, [&](uint64_t &bytes_in, uint64_t &bytes_out) {
+            int fds[2];
+            if (pipe2(fds, O_CLOEXEC) == -1) return false;
+            pid_t pid = TarWrapperNS::fork_tar(tar_args(tree), -1, fds[1], STDERR_FILENO, fds[0]);
+            close(fds[1]);
+            uint64_t drained = 0;
+            std::vector<char> buffer(1024 * 1024);
+            ssize_t nread;
+            while ((nread = read(fds[0], buffer.data(), buffer.size())) > 0 || (nread == -1 && errno == EINTR)) {
+                if (nread > 0) drained += nread;
+            }
+            close(fds[0]);
+            if (pid == -1 || TarWrapperNS::wait_child(pid) != 0) return false;
+            bytes_in = drained;
+            bytes_out = drained;
+            return true;
+        });
+        results.push_back(result);
+    }
+
+    auto measure_zstd = [&](int level, int workers, bool adaptive) {
+        char params[128];
+        snprintf(params, sizeof(params), "\"level\": %d, \"workers\": %d, \"adaptive\": %s", level, workers, adaptive ? "true" : "false");
+        Result result{"tar_zstd", params, {}, 0, 0};
+        ok &= measure(result, config.repeat, [&](uint64_t &bytes_in, uint64_t &bytes_out) {
+            std::atomic<int64_t> written{0};
+            TarWrapperNS::ArchiveOptions options;
+            options.roots = {tree};
+            options.output_fd = dev_null;
+            options.level = level;
+            options.workers = workers;
+            options.adaptive = adaptive;
+            options.text_level = std::max(level, 6);
+            options.progress = &written;
+            uint64_t read_before = trace_counter(TraceNS::counters_json(), "bytes_read");
+            if (TarWrapperNS::create_archive(options, STDERR_FILENO) != 0) return false;
+            bytes_in = trace_counter(TraceNS::counters_json(), "bytes_read") - read_before;
+            bytes_out = static_cast<uint64_t>(written.load());
+            return true;
+        });
+        results.push_back(result);
+    };
+    for (int workers: config.workers) {
+        for (int level: config.levels) {
+            measure_zstd(level, workers, false);
+        }
+        measure_zstd(config.levels.empty() ? 3 : config.levels.front(), workers, true);
+    }
+    close(dev_null);
+
+    std::string rustic = run_rustic(config, tree, work + "/rustic");
+
+    FILE *file = config.output.empty() ? stdout : fopen(config.output.c_str(), "we");
+    if (file == nullptr) {
+        fprintf(stderr, "Failed to open '%s': %s\n", config.output.c_str(), strerror(errno));
+        return 1;
+    }
+    write_json(file, config, stats, results, TraceNS::counters_json(), rustic);
+    if (file != stdout) fclose(file);
+
+    if (!config.keep && !remove_tree(work)) {
+        fprintf(stderr, "Failed to remove '%s'.\n", work.c_str());
+    }
+    return ok ? 0 : 1;
+}
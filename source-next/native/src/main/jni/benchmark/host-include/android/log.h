@@ -0,0 +1,28 @@
+#ifndef BENCHMARK_HOST_ANDROID_LOG_H
+#define BENCHMARK_HOST_ANDROID_LOG_H
+
+// Just enough of <android/log.h> to build the native engines on a Linux host, see host_log.cpp.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BENCHMARK_HOST_ANDROID_LOG_H
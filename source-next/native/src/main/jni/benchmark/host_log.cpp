@@ -0,0 +1,16 @@
+#include <android/log.h>
+
+#include <cstdarg>
+#include <cstdio>
+
+// Warnings and errors go to stderr, the rest would drown the JSON output in noise.
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    if (prio < ANDROID_LOG_WARN) return 0;
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "%s: ", tag);
+    int written = vfprintf(stderr, fmt, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return written;
+}
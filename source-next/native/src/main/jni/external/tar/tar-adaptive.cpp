@@ -0,0 +1,144 @@
+#include "tar-adaptive.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+namespace TarWrapperNS {
+    namespace {
+        constexpr size_t TAR_BLOCK_SIZE = 512;
+        constexpr size_t TAR_SIZE_OFFSET = 124;
+        constexpr size_t TAR_SIZE_LENGTH = 12;
+        constexpr size_t TAR_TYPEFLAG_OFFSET = 156;
+
+        // Bits per byte, random data measures ~7.95 on a 4 KiB sample, text stays below 6.
+        constexpr double INCOMPRESSIBLE_ENTROPY = 7.5;
+        constexpr double TEXT_PRINTABLE_RATIO = 0.95;
+
+        struct Magic {
+            size_t offset;
+            const char *bytes;
+            size_t length;
+        };
+
+        const Magic INCOMPRESSIBLE_MAGICS[] = {
+                {0, "PK\x03\x04",                 4}, // zip, apk, jar, docx
+                {0, "\x1f\x8b",                   2}, // gzip
+                {0, "\x28\xb5\x2f\xfd",           4}, // zstd
+                {0, "\xfd" "7zXZ\x00",            6}, // xz
+                {0, "BZh",                        3}, // bzip2
+                {0, "7z\xbc\xaf\x27\x1c",         6}, // 7z
+                {0, "\x04\x22\x4d\x18",           4}, // lz4
+                {0, "\xff\xd8\xff",               3}, // jpeg
+                {0, "\x89PNG",                    4},
+                {0, "GIF8",                       4},
+                {8, "WEBP",                       4}, // RIFF container
+                {4, "ftyp",                       4}, // mp4, m4a, heic, 3gp
+                {0, "OggS",                       4}, // ogg, opus
+                {0, "ID3",                        3}, // mp3
+                {0, "fLaC",                       4},
+                {0, "\x1a\x45\xdf\xa3",           4}, // mkv, webm
+        };
+
+        const Magic TEXT_MAGICS[] = {
+                {0, "SQLite format 3\x00", 16},
+        };
+
+        bool has_magic(const unsigned char *data, size_t size, const Magic &magic) {
+            return size >= magic.offset + magic.length && memcmp(data + magic.offset, magic.bytes, magic.length) == 0;
+        }
+
+        double byte_entropy(const unsigned char *data, size_t size) {
+            uint32_t histogram[256]{};
+            for (size_t i = 0; i < size; i++) histogram[data[i]]++;
+            double entropy = 0;
+            for (uint32_t count: histogram) {
+                if (count == 0) continue;
+                double p = static_cast<double>(count) / static_cast<double>(size);
+                entropy -= p * std::log2(p);
+            }
+            return entropy;
+        }
+
+        uint64_t parse_size(const unsigned char *field) {
+            uint64_t value = 0;
+            if (field[0] & 0x80) {
+                // GNU base-256 for sizes beyond 8 GiB.
+                value = field[0] & 0x7f;
+                for (size_t i = 1; i < TAR_SIZE_LENGTH; i++) value = (value << 8) | field[i];
+                return value;
+            }
+            for (size_t i = 0; i < TAR_SIZE_LENGTH; i++) {
+                unsigned char c = field[i];
+                if (c == ' ' && value == 0) continue;
+                if (c < '0' || c > '7') break;
+                value = (value << 3) | (c - '0');
+            }
+            return value;
+        }
+    }
+
+    ContentClass classify_content(const unsigned char *data, size_t size) {
+        for (const Magic &magic: TEXT_MAGICS) {
+            if (has_magic(data, size, magic)) return ContentClass::TEXT;
+        }
+        for (const Magic &magic: INCOMPRESSIBLE_MAGICS) {
+            if (has_magic(data, size, magic)) return ContentClass::INCOMPRESSIBLE;
+        }
+
+        size_t sample = std::min(size, CLASSIFY_SAMPLE_SIZE);
+        if (sample == 0) return ContentClass::DEFAULT;
+        if (byte_entropy(data, sample) >= INCOMPRESSIBLE_ENTROPY) {
+            return ContentClass::INCOMPRESSIBLE;
+        }
+        size_t printable = 0;
+        for (size_t i = 0; i < sample; i++) {
+            unsigned char c = data[i];
+            // Bytes >= 0x80 are counted for UTF-8 text.
+            if ((c >= 0x20 && c != 0x7f) || c == '\n' || c == '\r' || c == '\t') printable++;
+        }
+        if (static_cast<double>(printable) >= TEXT_PRINTABLE_RATIO * static_cast<double>(sample)) {
+            return ContentClass::TEXT;
+        }
+        return ContentClass::DEFAULT;
+    }
+
+    void TarMemberTracker::parse_header() {
+        mHeaderFilled = 0;
+        if (std::all_of(std::begin(mHeader), std::end(mHeader), [](unsigned char c) { return c == 0; })) {
+            // End of archive marker.
+            return;
+        }
+        uint64_t size = parse_size(mHeader + TAR_SIZE_OFFSET);
+        char type = static_cast<char>(mHeader[TAR_TYPEFLAG_OFFSET]);
+        // Hard links, symlinks, devices and directories carry no data whatever their size field says.
+        if (type == '1' || type == '2' || type == '3' || type == '4' || type == '5' || type == '6') {
+            size = 0;
+        }
+        mContentRemaining = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+        mIsFile = type == '0' || type == '\0' || type == '7';
+        mFileSize = size;
+        mFileStart = mIsFile && size > 0;
+    }
+
+    TarMemberTracker::Segment TarMemberTracker::next(const unsigned char *data, size_t size) {
+        Segment segment;
+        if (mContentRemaining > 0) {
+            segment.length = static_cast<size_t>(std::min<uint64_t>(mContentRemaining, size));
+            segment.file_content = mIsFile;
+            segment.file_start = mFileStart;
+            segment.file_size = mFileSize;
+            mFileStart = false;
+            mContentRemaining -= segment.length;
+            return segment;
+        }
+        segment.length = std::min(TAR_BLOCK_SIZE - mHeaderFilled, size);
+        memcpy(mHeader + mHeaderFilled, data, segment.length);
+        mHeaderFilled += segment.length;
+        if (mHeaderFilled == TAR_BLOCK_SIZE) {
+            parse_header();
+        }
+        return segment;
+    }
+}
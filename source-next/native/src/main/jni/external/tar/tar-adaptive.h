@@ -0,0 +1,56 @@
+#ifndef TAR_WRAPPER_TAR_ADAPTIVE_H
+#define TAR_WRAPPER_TAR_ADAPTIVE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace TarWrapperNS {
+    enum class ContentClass {
+        // Already compressed or encrypted (zip/apk, jpeg, mp4, ogg, ...), zstd gains nothing.
+        INCOMPRESSIBLE,
+        DEFAULT,
+        // Text and SQLite databases, worth a higher level.
+        TEXT,
+    };
+
+    // Bytes classify_content() looks at, give it this many unless the file is smaller.
+    constexpr size_t CLASSIFY_SAMPLE_SIZE = 4096;
+
+    /**
+     * Guesses how well a file compresses from its first bytes: magic numbers of well known
+     * formats first, then the share of printable bytes and the byte entropy of a sample.
+     */
+    ContentClass classify_content(const unsigned char *data, size_t size);
+
+    /**
+     * Follows the member boundaries of a tar stream fed to it in arbitrary pieces.
+     */
+    class TarMemberTracker {
+    public:
+        struct Segment {
+            size_t length = 0;
+            // Bytes of a regular file, the rest are headers, padding and metadata members.
+            bool file_content = false;
+            // First bytes of a file, `file_size` is its size from the header.
+            bool file_start = false;
+            uint64_t file_size = 0;
+        };
+
+        /**
+         * Splits the front of `data` off as the next segment, call until all of `size` is consumed.
+         */
+        Segment next(const unsigned char *data, size_t size);
+
+    private:
+        unsigned char mHeader[512]{};
+        size_t mHeaderFilled = 0;
+        uint64_t mContentRemaining = 0;
+        uint64_t mFileSize = 0;
+        bool mIsFile = false;
+        bool mFileStart = false;
+
+        void parse_header();
+    };
+}
+
+#endif //TAR_WRAPPER_TAR_ADAPTIVE_H
@@ -0,0 +1,497 @@
+#include "tar-archive.h"
+#include "tar-adaptive.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <android/log.h>
+#include <zstd.h>
+#include "trace.h"
+
+#define LOG_TAG "Tar-Wrapper"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#ifndef __NR_close_range
+#define __NR_close_range 436
+#endif
+
+// Entry point of the vendored tar, the host benchmark renames it as it has a main of its own.
+#ifdef TAR_MAIN
+extern "C" int TAR_MAIN(int argc, char **argv);
+#else
+#define TAR_MAIN main
+extern int main(int argc, char **argv);
+#endif
+
+namespace TarWrapperNS {
+    namespace {
+        // Large enough to keep every zstd worker fed with a full job per read.
+        constexpr size_t STREAM_BUFFER_SIZE = 4 * 1024 * 1024;
+        constexpr int PIPE_SIZE = 1024 * 1024;
+        constexpr size_t RING_BUFFER_SIZE = 16 * 1024 * 1024;
+        // Switching levels ends the zstd frame (and with workers, drains their pipeline), so only
+        // files this large get a level of their own. Smaller files go back to the base level, a run
+        // of them after a large file costs a single switch.
+        constexpr uint64_t ADAPTIVE_SWITCH_SIZE = 256 * 1024;
+
+        int level_for(ContentClass content, const ArchiveOptions &options) {
+            switch (content) {
+                case ContentClass::INCOMPRESSIBLE:
+                    return options.fast_level;
+                case ContentClass::TEXT:
+                    return options.text_level;
+                case ContentClass::DEFAULT:
+                    break;
+            }
+            return options.level;
+        }
+
+        struct CCtxDeleter {
+            void operator()(ZSTD_CCtx *cctx) const { ZSTD_freeCCtx(cctx); }
+        };
+
+        /**
+         * Writes a message in the "<what> failed: ENOSPC (No space left on device)" form
+         * the app side already looks for.
+         */
+        void report_error(int err_fd, const char *what, int error) {
+            ALOGE("%s failed: %s", what, strerror(error));
+            if (err_fd == -1) return;
+            dprintf(err_fd, "%s failed: %s(%s)\n", what, error == ENOSPC ? "ENOSPC " : "", strerror(error));
+        }
+
+        bool write_fully(int fd, const char *data, size_t size) {
+            while (size > 0) {
+                ssize_t written = write(fd, data, size);
+                if (written == -1) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                data += written;
+                size -= written;
+            }
+            return true;
+        }
+
+        /**
+         * Bounded single-producer/single-consumer byte queue between two pipeline stages.
+         * abort() wakes up both sides so any stage can tear the pipeline down.
+         */
+        class RingBuffer {
+        public:
+            explicit RingBuffer(size_t capacity) : mBuffer(capacity) {}
+
+            bool write(const char *data, size_t size) {
+                while (size > 0) {
+                    std::unique_lock<std::mutex> lock(mLock);
+                    mNotFull.wait(lock, [this] { return mAborted || mSize < mBuffer.size(); });
+                    if (mAborted) return false;
+                    size_t tail = (mHead + mSize) % mBuffer.size();
+                    size_t count = std::min({size, mBuffer.size() - mSize, mBuffer.size() - tail});
+                    memcpy(mBuffer.data() + tail, data, count);
+                    mSize += count;
+                    data += count;
+                    size -= count;
+                    mNotEmpty.notify_one();
+                }
+                return true;
+            }
+
+            // Returns 0 once the producer closed the buffer and everything was consumed, or on abort.
+            size_t read(char *data, size_t size) {
+                std::unique_lock<std::mutex> lock(mLock);
+                mNotEmpty.wait(lock, [this] { return mAborted || mClosed || mSize > 0; });
+                if (mAborted) return 0;
+                size_t count = std::min({size, mSize, mBuffer.size() - mHead});
+                memcpy(data, mBuffer.data() + mHead, count);
+                mHead = (mHead + count) % mBuffer.size();
+                mSize -= count;
+                mNotFull.notify_one();
+                return count;
+            }
+
+            void close() {
+                std::lock_guard<std::mutex> guard(mLock);
+                mClosed = true;
+                mNotEmpty.notify_all();
+            }
+
+            void abort() {
+                std::lock_guard<std::mutex> guard(mLock);
+                mAborted = true;
+                mNotEmpty.notify_all();
+                mNotFull.notify_all();
+            }
+
+        private:
+            std::vector<char> mBuffer;
+            std::mutex mLock;
+            std::condition_variable mNotEmpty;
+            std::condition_variable mNotFull;
+            size_t mHead = 0;
+            size_t mSize = 0;
+            bool mClosed = false;
+            bool mAborted = false;
+        };
+
+        struct DCtxDeleter {
+            void operator()(ZSTD_DCtx *dctx) const { ZSTD_freeDCtx(dctx); }
+        };
+
+        void close_inherited_fds() {
+            if (syscall(__NR_close_range, STDERR_FILENO + 1, ~0U, 0) == 0) return;
+            // Before 5.9, must not allocate after fork so /proc/self/fd is no option.
+            long max_fd = sysconf(_SC_OPEN_MAX);
+            if (max_fd < 0) max_fd = 1024;
+            for (int fd = STDERR_FILENO + 1; fd < max_fd; fd++) {
+                close(fd);
+            }
+        }
+    }
+
+    int wait_child(pid_t pid) {
+        int exit_status;
+        while (waitpid(pid, &exit_status, 0) == -1) {
+            if (errno != EINTR) {
+                ALOGE("Failed to get exit status.");
+                return -1;
+            }
+        }
+        return WIFEXITED(exit_status) ? WEXITSTATUS(exit_status) : -1;
+    }
+
+    pid_t fork_tar(const std::vector<std::string> &args, int in_fd, int out_fd, int err_fd, int idle_fd) {
+        // Build argv before forking, the child must not allocate through the JNI.
+        std::vector<char *> argv;
+        argv.reserve(args.size() + 1);
+        for (auto &arg: args) argv.push_back(const_cast<char *>(arg.c_str()));
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            // Set the parent death signal to SIGTERM: if the parent process exits,
+            // the kernel will send SIGTERM to this process.
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() == 1) {
+                _exit(SIGTERM);
+            }
+
+            if (in_fd != -1) dup2(in_fd, STDIN_FILENO);
+            if (out_fd != -1) dup2(out_fd, STDOUT_FILENO);
+            if (err_fd != -1) dup2(err_fd, STDERR_FILENO);
+            // Holding the other end of our own pipe would hide EOF/EPIPE from both sides.
+            if (idle_fd != -1) close(idle_fd);
+            // Same for pipes of jobs running concurrently in the parent, nothing execs so O_CLOEXEC does not help.
+            close_inherited_fds();
+
+            _exit(TAR_MAIN((int) args.size(), argv.data()));
+        } else if (pid == -1) {
+            ALOGE("Failed to fork.");
+        }
+        return pid;
+    }
+
+    int create_archive(const ArchiveOptions &options, int err_fd) {
+        TraceNS::Span span("tar.archive");
+        std::vector<std::string> args = {"tar", "-cpf", "-"};
+        for (auto &root: options.roots) {
+            size_t slash = root.find_last_of('/');
+            args.emplace_back("-C");
+            if (slash == std::string::npos) {
+                args.emplace_back(".");
+                args.emplace_back(root);
+            } else {
+                args.emplace_back(slash == 0 ? "/" : root.substr(0, slash));
+                args.emplace_back(root.substr(slash + 1));
+            }
+        }
+
+        std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx(ZSTD_createCCtx());
+        if (!cctx) {
+            report_error(err_fd, "ZSTD_createCCtx", ENOMEM);
+            return -1;
+        }
+        ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, options.level);
+        if (options.workers > 0) {
+            size_t ret = ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_nbWorkers, options.workers);
+            if (ZSTD_isError(ret)) {
+                ALOGW("Failed to set zstd workers: %s", ZSTD_getErrorName(ret));
+            }
+        }
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            report_error(err_fd, "pipe2", errno);
+            return -1;
+        }
+        // Fewer, larger reads; the default 64 KiB pipe wakes us up far too often.
+        fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+
+        pid_t pid = fork_tar(args, -1, fds[1], err_fd, fds[0]);
+        close(fds[1]);
+        if (pid == -1) {
+            close(fds[0]);
+            return -1;
+        }
+        if (options.watcher != nullptr) options.watcher->on_spawned(pid);
+
+        // Headroom to complete the classification sample of a large file starting at the end of a read,
+        // that file covers the rest of the buffer so it is topped up at most once per read.
+        std::unique_ptr<char[]> in_buffer(new char[STREAM_BUFFER_SIZE + CLASSIFY_SAMPLE_SIZE]);
+        std::unique_ptr<char[]> out_buffer(new char[STREAM_BUFFER_SIZE]);
+        auto compress = [&](const char *data, size_t size, ZSTD_EndDirective mode) {
+            TraceNS::Span compress_span("tar.compress");
+            ZSTD_inBuffer input = {data, size, 0};
+            bool finished;
+            do {
+                ZSTD_outBuffer output = {out_buffer.get(), STREAM_BUFFER_SIZE, 0};
+                size_t remaining = ZSTD_compressStream2(cctx.get(), &output, &input, mode);
+                if (ZSTD_isError(remaining)) {
+                    ALOGE("Failed to compress: %s", ZSTD_getErrorName(remaining));
+                    dprintf(err_fd, "ZSTD_compressStream2 failed: %s\n", ZSTD_getErrorName(remaining));
+                    return false;
+                }
+                TraceNS::add(TraceNS::BYTES_COMPRESSED, output.pos);
+                uint64_t write_start = TraceNS::now_ns();
+                if (!write_fully(options.output_fd, out_buffer.get(), output.pos)) {
+                    report_error(err_fd, "write", errno);
+                    return false;
+                }
+                TraceNS::add(TraceNS::WRITE_BLOCKED_NS, TraceNS::now_ns() - write_start);
+                if (options.progress != nullptr) {
+                    options.progress->fetch_add((int64_t) output.pos, std::memory_order_relaxed);
+                }
+                finished = mode == ZSTD_e_end ? remaining == 0 : input.pos == input.size;
+            } while (!finished);
+            return true;
+        };
+
+        /**
+         * Appends to `in_buffer` until it holds `size` bytes or the pipe is drained, returns false on read errors.
+         */
+        auto fill = [&fds, &in_buffer, &err_fd](size_t &filled, size_t size, bool &eof) -> bool {
+            while (filled < size) {
+                ssize_t nread;
+                {
+                    TraceNS::ScopedTimer blocked(TraceNS::PIPE_BLOCKED_NS);
+                    nread = read(fds[0], in_buffer.get() + filled, size - filled);
+                }
+                if (nread == -1) {
+                    if (errno == EINTR) continue;
+                    report_error(err_fd, "read", errno);
+                    return false;
+                }
+                TraceNS::add(TraceNS::BYTES_READ, nread);
+                if (nread == 0) {
+                    eof = true;
+                    break;
+                }
+                filled += nread;
+            }
+            return true;
+        };
+
+        TarMemberTracker tracker;
+        int current_level = options.level;
+        bool failed = false;
+        bool eof = false;
+        while (!eof && !failed) {
+            ssize_t result;
+            {
+                TraceNS::ScopedTimer blocked(TraceNS::PIPE_BLOCKED_NS);
+                result = read(fds[0], in_buffer.get(), STREAM_BUFFER_SIZE);
+            }
+            if (result == -1) {
+                if (errno == EINTR) continue;
+                report_error(err_fd, "read", errno);
+                failed = true;
+                break;
+            }
+            eof = result == 0;
+            TraceNS::add(TraceNS::BYTES_READ, result);
+            auto nread = static_cast<size_t>(result);
+            const char *pending = in_buffer.get();
+            if (options.adaptive) {
+                auto *bytes = reinterpret_cast<const unsigned char *>(in_buffer.get());
+                size_t offset = 0;
+                while (offset < nread && !failed) {
+                    TarMemberTracker::Segment segment = tracker.next(bytes + offset, nread - offset);
+                    if (segment.file_start) {
+                        int level = options.level;
+                        if (segment.file_size >= ADAPTIVE_SWITCH_SIZE) {
+                            // Don't judge a file by the few bytes that made it into this read.
+                            if (!eof && nread - offset < CLASSIFY_SAMPLE_SIZE) {
+                                failed = !fill(nread, offset + CLASSIFY_SAMPLE_SIZE, eof);
+                            }
+                            level = level_for(classify_content(bytes + offset, std::min(nread - offset, CLASSIFY_SAMPLE_SIZE)), options);
+                        }
+                        if (!failed && level != current_level) {
+                            // The level only changes with a new frame, concatenated frames decode as one stream.
+                            const char *boundary = in_buffer.get() + offset;
+                            failed = !compress(pending, boundary - pending, ZSTD_e_end);
+                            ZSTD_CCtx_setParameter(cctx.get(), ZSTD_c_compressionLevel, level);
+                            current_level = level;
+                            pending = boundary;
+                        }
+                    }
+                    offset += segment.length;
+                }
+            }
+            if (!failed) {
+                const char *end = in_buffer.get() + nread;
+                failed = !compress(pending, end - pending, eof ? ZSTD_e_end : ZSTD_e_continue);
+            }
+        }
+        close(fds[0]);
+
+        if (failed) {
+            // Nobody drains the pipe anymore, don't leave tar blocked on it.
+            if (options.watcher != nullptr) {
+                options.watcher->terminate(pid);
+            } else {
+                kill(pid, SIGTERM);
+            }
+        }
+        int status = options.watcher != nullptr ? options.watcher->wait(pid) : wait_child(pid);
+        return failed ? -1 : status;
+    }
+
+    int extract_archive(const ExtractOptions &options, int err_fd) {
+        TraceNS::Span span("tar.extract");
+        std::vector<std::string> args = {"tar", "-xpf", "-", "-C", options.destination};
+
+        std::unique_ptr<ZSTD_DCtx, DCtxDeleter> dctx(ZSTD_createDCtx());
+        if (!dctx) {
+            report_error(err_fd, "ZSTD_createDCtx", ENOMEM);
+            return -1;
+        }
+
+        // A socket instead of a pipe: if tar bails out early, send() reports EPIPE
+        // through MSG_NOSIGNAL rather than raising SIGPIPE in the root service.
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+            report_error(err_fd, "socketpair", errno);
+            return -1;
+        }
+        shutdown(fds[0], SHUT_RD);
+        shutdown(fds[1], SHUT_WR);
+        pid_t pid = fork_tar(args, fds[1], -1, err_fd, fds[0]);
+        close(fds[1]);
+        if (pid == -1) {
+            close(fds[0]);
+            return -1;
+        }
+        if (options.watcher != nullptr) options.watcher->on_spawned(pid);
+
+        posix_fadvise(options.input_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        RingBuffer compressed(RING_BUFFER_SIZE);
+        RingBuffer decompressed(RING_BUFFER_SIZE);
+        std::atomic<bool> failed{false};
+        auto fail = [&] {
+            failed = true;
+            compressed.abort();
+            decompressed.abort();
+        };
+
+        // Stage 1: read-ahead.
+        std::thread reader([&] {
+            TraceNS::Span reader_span("tar.read_ahead");
+            std::unique_ptr<char[]> buffer(new char[PIPE_SIZE]);
+            while (true) {
+                ssize_t nread = read(options.input_fd, buffer.get(), PIPE_SIZE);
+                if (nread == -1) {
+                    if (errno == EINTR) continue;
+                    report_error(err_fd, "read", errno);
+                    fail();
+                    return;
+                }
+                if (nread == 0) break;
+                if (options.progress != nullptr) {
+                    options.progress->fetch_add(nread, std::memory_order_relaxed);
+                }
+                if (!compressed.write(buffer.get(), nread)) return;
+            }
+            compressed.close();
+        });
+
+        // Stage 2: decompression.
+        std::thread decompressor([&] {
+            TraceNS::Span decompressor_span("tar.decompress");
+            std::unique_ptr<char[]> in_buffer(new char[PIPE_SIZE]);
+            std::unique_ptr<char[]> out_buffer(new char[PIPE_SIZE]);
+            size_t last = 0;
+            size_t nread;
+            while ((nread = compressed.read(in_buffer.get(), PIPE_SIZE)) > 0) {
+                ZSTD_inBuffer input = {in_buffer.get(), nread, 0};
+                while (input.pos < input.size) {
+                    ZSTD_outBuffer output = {out_buffer.get(), PIPE_SIZE, 0};
+                    last = ZSTD_decompressStream(dctx.get(), &output, &input);
+                    if (ZSTD_isError(last)) {
+                        ALOGE("Failed to decompress: %s", ZSTD_getErrorName(last));
+                        dprintf(err_fd, "ZSTD_decompressStream failed: %s\n", ZSTD_getErrorName(last));
+                        fail();
+                        return;
+                    }
+                    TraceNS::add(TraceNS::BYTES_DECOMPRESSED, output.pos);
+                    if (!decompressed.write(out_buffer.get(), output.pos)) return;
+                }
+            }
+            if (failed) return;
+            if (last != 0) {
+                ALOGE("Truncated zstd stream.");
+                dprintf(err_fd, "ZSTD_decompressStream failed: Truncated input\n");
+                fail();
+                return;
+            }
+            decompressed.close();
+        });
+
+        // Stage 3: feed tar on this thread.
+        std::unique_ptr<char[]> buffer(new char[PIPE_SIZE]);
+        size_t nread;
+        while ((nread = decompressed.read(buffer.get(), PIPE_SIZE)) > 0) {
+            const char *data = buffer.get();
+            while (nread > 0) {
+                ssize_t sent;
+                {
+                    TraceNS::ScopedTimer blocked(TraceNS::PIPE_BLOCKED_NS);
+                    sent = send(fds[0], data, nread, MSG_NOSIGNAL);
+                }
+                if (sent == -1) {
+                    if (errno == EINTR) continue;
+                    // EPIPE means tar exited on its own, its status tells why.
+                    if (errno != EPIPE) report_error(err_fd, "send", errno);
+                    fail();
+                    break;
+                }
+                TraceNS::add(TraceNS::BYTES_READ, sent);
+                data += sent;
+                nread -= sent;
+            }
+            if (failed) break;
+        }
+        close(fds[0]);
+        reader.join();
+        decompressor.join();
+
+        int status = options.watcher != nullptr ? options.watcher->wait(pid) : wait_child(pid);
+        return failed && status == 0 ? -1 : status;
+    }
+}
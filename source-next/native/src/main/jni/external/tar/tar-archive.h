@@ -0,0 +1,80 @@
+#ifndef TAR_WRAPPER_TAR_ARCHIVE_H
+#define TAR_WRAPPER_TAR_ARCHIVE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace TarWrapperNS {
+    /**
+     * Lets a caller take over reaping of the tar child, e.g. to make it cancellable.
+     * Without one the child is reaped with a blocking waitpid().
+     */
+    class ChildWatcher {
+    public:
+        virtual ~ChildWatcher() = default;
+
+        virtual void on_spawned(pid_t pid) = 0;
+
+        // Blocks until `pid` exited, returns its exit code or -1.
+        virtual int wait(pid_t pid) = 0;
+
+        // Sends SIGTERM to `pid` unless it was reaped already, its pid may have been reused then.
+        virtual void terminate(pid_t pid) = 0;
+    };
+
+    struct ArchiveOptions {
+        // Absolute paths, each one is archived as "-C <parent> <name>".
+        std::vector<std::string> roots;
+        int output_fd = -1;
+        int level = 1;
+        int workers = 0;
+        // Picks the level per large file from its content: `fast_level` for already compressed files,
+        // `text_level` for text and databases and `level` for everything else, small files use `level`.
+        bool adaptive = false;
+        int fast_level = -5;
+        int text_level = 1;
+        // Compressed bytes written to output_fd so far, may be nullptr.
+        std::atomic<int64_t> *progress = nullptr;
+        ChildWatcher *watcher = nullptr;
+    };
+
+    struct ExtractOptions {
+        int input_fd = -1;
+        // Directory the archive entries are extracted into, i.e. the parent of the archived roots.
+        std::string destination;
+        // Compressed bytes read from input_fd so far, may be nullptr.
+        std::atomic<int64_t> *progress = nullptr;
+        ChildWatcher *watcher = nullptr;
+    };
+
+    /**
+     * Forks the vendored tar with its STDIN/STDOUT/STDERR redirected to the given fds,
+     * -1 keeps the inherited one. `idle_fd` is closed in the child, pass the end of a
+     * pipe the parent keeps. Returns the child pid or -1.
+     */
+    pid_t fork_tar(const std::vector<std::string> &args, int in_fd, int out_fd, int err_fd, int idle_fd = -1);
+
+    /**
+     * Returns the exit code of `pid`, or -1 if it was killed by a signal.
+     */
+    int wait_child(pid_t pid);
+
+    /**
+     * Archives `options.roots` with tar and streams the output through a multithreaded
+     * ZSTD_CCtx straight into `options.output_fd`, without the FIFO and JVM copy.
+     * Errors are appended to `err_fd`. Returns the tar exit code or -1.
+     */
+    int create_archive(const ArchiveOptions &options, int err_fd);
+
+    /**
+     * Restores a tar.zst from `options.input_fd`. Read-ahead, zstd decompression and tar
+     * extraction run concurrently, connected by bounded ring buffers.
+     * Errors are appended to `err_fd`. Returns the tar exit code or -1.
+     */
+    int extract_archive(const ExtractOptions &options, int err_fd);
+}
+
+#endif //TAR_WRAPPER_TAR_ARCHIVE_H
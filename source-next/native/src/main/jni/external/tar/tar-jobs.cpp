@@ -0,0 +1,413 @@
+#include "tar-jobs.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <android/log.h>
+
+#define LOG_TAG "Tar-Wrapper"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+namespace TarWrapperNS {
+    namespace {
+        // Kernels without pidfd (< 5.3) are polled with waitpid(WNOHANG) at this interval.
+        constexpr int FALLBACK_POLL_MS = 100;
+        constexpr int MAX_EVENTS = 16;
+
+        enum class JobState {
+            QUEUED, RUNNING, FINISHED
+        };
+
+        struct Job;
+
+        struct Jobs {
+            std::mutex lock;
+            std::condition_variable changed;
+            std::unordered_map<int64_t, std::shared_ptr<Job>> jobs;
+            std::deque<std::shared_ptr<Job>> queue;
+            int64_t next_id = 1;
+            size_t running = 0;
+            size_t max_running = std::max<size_t>(1, std::thread::hardware_concurrency());
+            // Children without a pidfd, reaped by polling.
+            std::vector<std::shared_ptr<Job>> polled;
+            int epoll_fd = -1;
+            int wake_fd = -1;
+            bool reaper_started = false;
+        };
+
+        Jobs &jobs() {
+            // Never destroyed, the reaper and runner threads are detached.
+            static auto *instance = new Jobs();
+            return *instance;
+        }
+
+        struct Job : ChildWatcher {
+            int64_t id = 0;
+            JobState state = JobState::QUEUED;
+            // Starts the runner thread of a streaming job, called with the lock held.
+            std::function<void(const std::shared_ptr<Job> &)> start;
+            bool streaming = false;
+            // Cli jobs are short and never wait behind archives, they are not counted against max_running.
+            bool limited = true;
+            pid_t pid = -1;
+            int pidfd = -1;
+            bool exited = false;
+            int exit_code = -1;
+            bool canceled = false;
+            int result = JOB_RUNNING;
+            std::vector<int> fds;
+            ArchiveOptions archive;
+            ExtractOptions extract;
+
+            void on_spawned(pid_t child) override;
+
+            int wait(pid_t) override {
+                std::unique_lock<std::mutex> guard(jobs().lock);
+                jobs().changed.wait(guard, [this] { return exited; });
+                return exit_code;
+            }
+
+            void terminate(pid_t) override {
+                std::lock_guard<std::mutex> guard(jobs().lock);
+                // The reaper collects the child with the lock held, so it is still ours here.
+                if (pid > 0 && !exited) {
+                    kill(pid, SIGTERM);
+                }
+            }
+        };
+
+        void wake_reaper(Jobs &state) {
+            uint64_t one = 1;
+            if (write(state.wake_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+                ALOGE("Failed to wake reaper: %s", strerror(errno));
+            }
+        }
+
+        void start_queued_locked(Jobs &state);
+
+        void finish_locked(Jobs &state, const std::shared_ptr<Job> &job, int result) {
+            bool was_running = job->state == JobState::RUNNING;
+            job->state = JobState::FINISHED;
+            job->result = job->canceled ? JOB_CANCELED : result;
+            for (int fd: job->fds) close(fd);
+            job->fds.clear();
+            if (was_running && job->limited) {
+                state.running--;
+                start_queued_locked(state);
+            }
+            state.changed.notify_all();
+        }
+
+        void start_locked(Jobs &state, const std::shared_ptr<Job> &job) {
+            job->state = JobState::RUNNING;
+            state.running++;
+            auto start = std::move(job->start);
+            job->start = nullptr;
+            start(job);
+        }
+
+        void start_queued_locked(Jobs &state) {
+            while (state.running < state.max_running && !state.queue.empty()) {
+                auto job = state.queue.front();
+                state.queue.pop_front();
+                start_locked(state, job);
+            }
+        }
+
+        /**
+         * Called with the lock held once `job` has a live child. The child stays a zombie
+         * until reap_locked() collected it, so signalling `job->pid` before that is safe.
+         */
+        void watch_locked(Jobs &state, const std::shared_ptr<Job> &job, pid_t pid) {
+            job->pid = pid;
+            if (job->canceled) {
+                kill(pid, SIGTERM);
+            }
+            job->pidfd = static_cast<int>(syscall(__NR_pidfd_open, pid, 0));
+            if (job->pidfd != -1) {
+                struct epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.u64 = static_cast<uint64_t>(job->id);
+                if (epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, job->pidfd, &event) == 0) {
+                    return;
+                }
+                ALOGW("Failed to watch pidfd: %s", strerror(errno));
+                close(job->pidfd);
+                job->pidfd = -1;
+            }
+            state.polled.push_back(job);
+            wake_reaper(state);
+        }
+
+        // Returns true if the child of `job` was collected.
+        bool reap_locked(Jobs &state, const std::shared_ptr<Job> &job) {
+            int exit_status;
+            pid_t ret = waitpid(job->pid, &exit_status, WNOHANG);
+            if (ret == 0 || (ret == -1 && errno == EINTR)) {
+                return false;
+            }
+            if (ret == -1) {
+                ALOGE("Failed to get exit status: %s", strerror(errno));
+                job->exit_code = -1;
+            } else {
+                job->exit_code = WIFEXITED(exit_status) ? WEXITSTATUS(exit_status) : -1;
+            }
+            job->exited = true;
+            if (job->pidfd != -1) {
+                close(job->pidfd);
+                job->pidfd = -1;
+            }
+            if (job->streaming) {
+                // The runner thread is blocked in Job::wait() and finishes the job itself.
+                state.changed.notify_all();
+            } else {
+                finish_locked(state, job, job->exit_code);
+            }
+            return true;
+        }
+
+        void reaper_loop() {
+            Jobs &state = jobs();
+            struct epoll_event events[MAX_EVENTS];
+            while (true) {
+                int timeout;
+                {
+                    std::lock_guard<std::mutex> guard(state.lock);
+                    timeout = state.polled.empty() ? -1 : FALLBACK_POLL_MS;
+                }
+                int count = epoll_wait(state.epoll_fd, events, MAX_EVENTS, timeout);
+                if (count == -1 && errno != EINTR) {
+                    ALOGE("Failed to wait for children: %s", strerror(errno));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(FALLBACK_POLL_MS));
+                    continue;
+                }
+
+                std::lock_guard<std::mutex> guard(state.lock);
+                for (int i = 0; i < count; i++) {
+                    if (events[i].data.u64 == 0) {
+                        uint64_t value;
+                        read(state.wake_fd, &value, sizeof(value));
+                        continue;
+                    }
+                    auto it = state.jobs.find(static_cast<int64_t>(events[i].data.u64));
+                    if (it != state.jobs.end() && !it->second->exited) {
+                        reap_locked(state, it->second);
+                    }
+                }
+                for (auto it = state.polled.begin(); it != state.polled.end();) {
+                    if (reap_locked(state, *it)) {
+                        it = state.polled.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+        }
+
+        void ensure_reaper_locked(Jobs &state) {
+            if (state.reaper_started) return;
+            state.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            state.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            struct epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.u64 = 0;
+            epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, state.wake_fd, &event);
+            std::thread(reaper_loop).detach();
+            state.reaper_started = true;
+        }
+
+        void register_locked(Jobs &state, const std::shared_ptr<Job> &job) {
+            ensure_reaper_locked(state);
+            job->id = state.next_id++;
+            state.jobs.emplace(job->id, job);
+        }
+
+        int64_t submit(const std::shared_ptr<Job> &job) {
+            Jobs &state = jobs();
+            std::lock_guard<std::mutex> guard(state.lock);
+            register_locked(state, job);
+            if (state.running < state.max_running && state.queue.empty()) {
+                start_locked(state, job);
+            } else {
+                state.queue.push_back(job);
+            }
+            return job->id;
+        }
+
+        void Job::on_spawned(pid_t child) {
+            Jobs &state = jobs();
+            std::lock_guard<std::mutex> guard(state.lock);
+            auto it = state.jobs.find(id);
+            if (it != state.jobs.end()) {
+                watch_locked(state, it->second, child);
+            }
+        }
+
+        /**
+         * Streaming jobs pump data on their own thread and only hand the tar child to the reaper.
+         */
+        void start_runner(const std::shared_ptr<Job> &job, std::function<int(Job &)> run) {
+            job->streaming = true;
+            std::thread([job, run]() {
+                int result = run(*job);
+                Jobs &state = jobs();
+                std::lock_guard<std::mutex> guard(state.lock);
+                finish_locked(state, job, result);
+            }).detach();
+        }
+    }
+
+    JobManager &JobManager::instance() {
+        static JobManager manager;
+        return manager;
+    }
+
+    int64_t JobManager::spawn_cli(std::vector<std::string> args, int out_fd, int err_fd) {
+        auto job = std::make_shared<Job>();
+        job->fds = {out_fd, err_fd};
+        job->limited = false;
+        job->state = JobState::RUNNING;
+        Jobs &state = jobs();
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            register_locked(state, job);
+        }
+        // Forked without the lock, a cancel() in between is applied by watch_locked().
+        pid_t pid = fork_tar(args, -1, out_fd, err_fd);
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (pid == -1) {
+            finish_locked(state, job, -1);
+        } else {
+            watch_locked(state, job, pid);
+        }
+        return job->id;
+    }
+
+    int64_t JobManager::spawn_archive(ArchiveOptions options, int err_fd) {
+        auto job = std::make_shared<Job>();
+        job->fds = {options.output_fd, err_fd};
+        job->archive = std::move(options);
+        job->archive.watcher = job.get();
+        job->start = [err_fd](const std::shared_ptr<Job> &self) {
+            start_runner(self, [err_fd](Job &job) { return create_archive(job.archive, err_fd); });
+        };
+        return submit(job);
+    }
+
+    int64_t JobManager::spawn_extract(ExtractOptions options, int err_fd) {
+        auto job = std::make_shared<Job>();
+        job->fds = {options.input_fd, err_fd};
+        job->extract = std::move(options);
+        job->extract.watcher = job.get();
+        job->start = [err_fd](const std::shared_ptr<Job> &self) {
+            start_runner(self, [err_fd](Job &job) { return extract_archive(job.extract, err_fd); });
+        };
+        return submit(job);
+    }
+
+    int JobManager::poll(int64_t id) {
+        Jobs &state = jobs();
+        std::lock_guard<std::mutex> guard(state.lock);
+        auto it = state.jobs.find(id);
+        if (it == state.jobs.end()) return JOB_UNKNOWN;
+        return it->second->result;
+    }
+
+    int JobManager::wait(int64_t id, int64_t timeout_ms) {
+        Jobs &state = jobs();
+        std::unique_lock<std::mutex> guard(state.lock);
+        auto it = state.jobs.find(id);
+        if (it == state.jobs.end()) return JOB_UNKNOWN;
+        auto job = it->second;
+        auto finished = [&job] { return job->state == JobState::FINISHED; };
+        if (timeout_ms < 0) {
+            state.changed.wait(guard, finished);
+        } else {
+            state.changed.wait_for(guard, std::chrono::milliseconds(timeout_ms), finished);
+        }
+        return job->result;
+    }
+
+    bool JobManager::cancel(int64_t id) {
+        Jobs &state = jobs();
+        std::lock_guard<std::mutex> guard(state.lock);
+        auto it = state.jobs.find(id);
+        if (it == state.jobs.end()) return false;
+        auto job = it->second;
+        switch (job->state) {
+            case JobState::QUEUED:
+                for (auto queued = state.queue.begin(); queued != state.queue.end(); ++queued) {
+                    if (*queued == job) {
+                        state.queue.erase(queued);
+                        break;
+                    }
+                }
+                job->canceled = true;
+                finish_locked(state, job, JOB_CANCELED);
+                return true;
+            case JobState::RUNNING:
+                job->canceled = true;
+                // A streaming job which has not forked yet is killed in watch_locked().
+                if (job->pid > 0 && !job->exited) {
+                    kill(job->pid, SIGTERM);
+                }
+                return true;
+            case JobState::FINISHED:
+                return false;
+        }
+        return false;
+    }
+
+    void JobManager::cancel_all() {
+        std::vector<int64_t> ids;
+        {
+            Jobs &state = jobs();
+            std::lock_guard<std::mutex> guard(state.lock);
+            for (auto &entry: state.jobs) {
+                if (entry.second->state != JobState::FINISHED) ids.push_back(entry.first);
+            }
+        }
+        for (int64_t id: ids) {
+            cancel(id);
+        }
+    }
+
+    void JobManager::release(int64_t id) {
+        Jobs &state = jobs();
+        std::lock_guard<std::mutex> guard(state.lock);
+        auto it = state.jobs.find(id);
+        // Unfinished jobs are still referenced by the reaper and runner threads.
+        if (it != state.jobs.end() && it->second->state == JobState::FINISHED) {
+            state.jobs.erase(it);
+        }
+    }
+
+    void JobManager::set_max_running(size_t max_running) {
+        Jobs &state = jobs();
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.max_running = std::max<size_t>(1, max_running);
+        start_queued_locked(state);
+    }
+}
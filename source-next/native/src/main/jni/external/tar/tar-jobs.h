@@ -0,0 +1,65 @@
+#ifndef TAR_WRAPPER_TAR_JOBS_H
+#define TAR_WRAPPER_TAR_JOBS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tar-archive.h"
+
+namespace TarWrapperNS {
+    // Returned by poll()/wait() instead of an exit code.
+    constexpr int JOB_RUNNING = -2;
+    constexpr int JOB_CANCELED = -3;
+    constexpr int JOB_UNKNOWN = -4;
+
+    /**
+     * Runs tar invocations as asynchronous jobs.
+     *
+     * Children are reaped by a single thread blocking in epoll on their pidfds, so
+     * callers poll, wait with a timeout or cancel instead of sitting in waitpid().
+     * At most `max_running` archive and extract jobs run at once, the rest are queued in
+     * spawn order. Cli jobs are short and always start right away.
+     *
+     * Every spawn_*() takes ownership of the fds it is given, they are closed once the
+     * job finished. A finished job keeps its result until release() is called.
+     */
+    class JobManager {
+    public:
+        static JobManager &instance();
+
+        int64_t spawn_cli(std::vector<std::string> args, int out_fd, int err_fd);
+
+        int64_t spawn_archive(ArchiveOptions options, int err_fd);
+
+        int64_t spawn_extract(ExtractOptions options, int err_fd);
+
+        /**
+         * Returns the exit code of a finished job, JOB_RUNNING while it is queued or
+         * running, JOB_CANCELED if it was canceled or JOB_UNKNOWN for a released id.
+         */
+        int poll(int64_t id);
+
+        /**
+         * Same as poll() but blocks up to `timeout_ms` for the job to finish, forever if negative.
+         */
+        int wait(int64_t id, int64_t timeout_ms);
+
+        /**
+         * Sends SIGTERM to the tar child of a running job, a queued job never starts.
+         * Returns false if the job already finished.
+         */
+        bool cancel(int64_t id);
+
+        void cancel_all();
+
+        void release(int64_t id);
+
+        void set_max_running(size_t max_running);
+
+    private:
+        JobManager() = default;
+    };
+}
+
+#endif //TAR_WRAPPER_TAR_JOBS_H
@@ -12,6 +12,10 @@
 #include <asm-generic/fcntl.h>
 #include <fcntl.h>
 #include <sys/prctl.h>
+#include <atomic>
+#include <vector>
+#include "tar-archive.h"
+#include "tar-jobs.h"
 
 #define LOG_TAG "Tar-Wrapper"
 #define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
@@ -22,97 +26,148 @@
 
 extern int main(int argc, char **argv);
 
-extern "C" JNIEXPORT jint JNICALL
-Java_com_xayah_libnative_TarWrapper_callCli(JNIEnv *env, jobject, jstring std_out, jstring std_err, jobjectArray j_argv) {
-    const char *out_path = env->GetStringUTFChars(std_out, nullptr);
-    const char *err_path = env->GetStringUTFChars(std_err, nullptr);
-
-    // Save previous STDOUT/STDERR
-    int saved_stdout = dup(STDOUT_FILENO);
-    int saved_stderr = dup(STDERR_FILENO);
-
-    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    int err_fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-    // Release jni strings
-    env->ReleaseStringUTFChars(std_out, out_path);
-    env->ReleaseStringUTFChars(std_err, err_path);
-
-    if (out_fd == -1 || err_fd == -1) {
-        ALOGE("Failed to open STDOUT/STDERR files.");
-        if (out_fd != -1) close(out_fd);
-        if (err_fd != -1) close(err_fd);
-        if (saved_stdout != -1) close(saved_stdout);
-        if (saved_stderr != -1) close(saved_stderr);
-        return -1;
+namespace {
+    std::vector<std::string> read_string_array(JNIEnv *env, jobjectArray array) {
+        std::vector<std::string> strings;
+        jsize count = env->GetArrayLength(array);
+        strings.reserve(count);
+        for (int i = 0; i < count; i++) {
+            auto str = (jstring) env->GetObjectArrayElement(array, i);
+            const char *utf = env->GetStringUTFChars(str, nullptr);
+            strings.emplace_back(utf);
+            env->ReleaseStringUTFChars(str, utf);
+            env->DeleteLocalRef(str);
+        }
+        return strings;
+    }
+
+    int open_output(JNIEnv *env, jstring path) {
+        const char *utf = env->GetStringUTFChars(path, nullptr);
+        int fd = open(utf, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        env->ReleaseStringUTFChars(path, utf);
+        return fd;
     }
 
-    pid_t pid = fork();
-    if (pid == 0) {
-        // Set the parent death signal to SIGTERM: if the parent process exits,
-        // the kernel will send SIGTERM to this process.
-        prctl(PR_SET_PDEATHSIG, SIGTERM);
-        if (getppid() == 1) {
-            _exit(SIGTERM);
+    int64_t spawn_cli(JNIEnv *env, jstring std_out, jstring std_err, jobjectArray j_argv) {
+        int out_fd = open_output(env, std_out);
+        int err_fd = open_output(env, std_err);
+        if (out_fd == -1 || err_fd == -1) {
+            ALOGE("Failed to open STDOUT/STDERR files.");
+            if (out_fd != -1) close(out_fd);
+            if (err_fd != -1) close(err_fd);
+            return -1;
         }
+        return TarWrapperNS::JobManager::instance().spawn_cli(read_string_array(env, j_argv), out_fd, err_fd);
+    }
+}
 
-        // Redirect STDOUT/STDERR
-        dup2(out_fd, STDOUT_FILENO);
-        dup2(err_fd, STDERR_FILENO);
+extern "C" JNIEXPORT jint JNICALL
+Java_com_xayah_libnative_TarWrapper_callCli(JNIEnv *env, jobject, jstring std_out, jstring std_err, jobjectArray j_argv) {
+    int64_t job = spawn_cli(env, std_out, std_err, j_argv);
+    if (job == -1) return -1;
+    auto &jobs = TarWrapperNS::JobManager::instance();
+    int result = jobs.wait(job, -1);
+    jobs.release(job);
+    return result;
+}
 
-        // Close idle fds
-        close(out_fd);
-        close(err_fd);
-        close(saved_stdout);
-        close(saved_stderr);
-
-        // Build argv
-        jsize argc = env->GetArrayLength(j_argv);
-        char **argv = (char **) malloc((argc + 1) * sizeof(char *));
-        for (int i = 0; i < argc; i++) {
-            auto arg_str = (jstring) env->GetObjectArrayElement(j_argv, i);
-            const char *arg_utf = env->GetStringUTFChars(arg_str, nullptr);
-            argv[i] = strdup(arg_utf);  // Copy then release to avoid memory leak
-            env->ReleaseStringUTFChars(arg_str, arg_utf);
-            env->DeleteLocalRef(arg_str);
-        }
-        argv[argc] = nullptr;
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_TarWrapper_spawnCli(JNIEnv *env, jobject, jstring std_out, jstring std_err, jobjectArray j_argv) {
+    return spawn_cli(env, std_out, std_err, j_argv);
+}
 
-        int result = main(argc, argv);
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_TarWrapper_newProgress(JNIEnv *, jobject) {
+    return reinterpret_cast<jlong>(new std::atomic<int64_t>(0));
+}
 
-        // Release string resources
-        for (int i = 0; i < argc; i++) {
-            free(argv[i]);
-        }
-        free(argv);
-        _exit(result);
-    } else if (pid > 0) {
-        // Close idle fds
-        close(out_fd);
-        close(err_fd);
-        close(saved_stdout);
-        close(saved_stderr);
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_TarWrapper_readProgress(JNIEnv *, jobject, jlong handle) {
+    return reinterpret_cast<std::atomic<int64_t> *>(handle)->load(std::memory_order_relaxed);
+}
 
-        int exit_status;
+extern "C" JNIEXPORT void JNICALL
+Java_com_xayah_libnative_TarWrapper_freeProgress(JNIEnv *, jobject, jlong handle) {
+    delete reinterpret_cast<std::atomic<int64_t> *>(handle);
+}
 
-        // Wait for child process to exit.
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            ALOGE("Failed to get exit status.");
-            return -1;
-        }
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_TarWrapper_spawnArchive(JNIEnv *env, jobject, jstring std_err, jobjectArray j_roots, jint output_fd, jint level,
+                                                 jboolean adaptive, jint fast_level, jint text_level, jint workers, jlong progress) {
+    int err_fd = open_output(env, std_err);
+    if (err_fd == -1) {
+        ALOGE("Failed to open STDERR file.");
+        return -1;
+    }
+    // The job outlives the caller's descriptor.
+    int job_output_fd = fcntl(output_fd, F_DUPFD_CLOEXEC, 0);
+    if (job_output_fd == -1) {
+        ALOGE("Failed to dup output fd.");
+        close(err_fd);
+        return -1;
+    }
 
-        // Get the exit code from child process
-        if (WIFEXITED(exit_status)) {
-            return WEXITSTATUS(exit_status);
-        } else {
-            return -1;
-        }
-    } else {
-        ALOGE("Failed to fork.");
-        close(out_fd);
+    TarWrapperNS::ArchiveOptions options;
+    options.roots = read_string_array(env, j_roots);
+    options.output_fd = job_output_fd;
+    options.level = level;
+    options.adaptive = adaptive;
+    options.fast_level = fast_level;
+    options.text_level = text_level;
+    options.workers = workers;
+    options.progress = reinterpret_cast<std::atomic<int64_t> *>(progress);
+    return TarWrapperNS::JobManager::instance().spawn_archive(std::move(options), err_fd);
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_TarWrapper_spawnExtract(JNIEnv *env, jobject, jstring std_err, jint input_fd, jstring destination, jlong progress) {
+    int err_fd = open_output(env, std_err);
+    if (err_fd == -1) {
+        ALOGE("Failed to open STDERR file.");
+        return -1;
+    }
+    int job_input_fd = fcntl(input_fd, F_DUPFD_CLOEXEC, 0);
+    if (job_input_fd == -1) {
+        ALOGE("Failed to dup input fd.");
         close(err_fd);
-        close(saved_stdout);
-        close(saved_stderr);
         return -1;
     }
+
+    TarWrapperNS::ExtractOptions options;
+    const char *destination_utf = env->GetStringUTFChars(destination, nullptr);
+    options.destination = destination_utf;
+    env->ReleaseStringUTFChars(destination, destination_utf);
+    options.input_fd = job_input_fd;
+    options.progress = reinterpret_cast<std::atomic<int64_t> *>(progress);
+    return TarWrapperNS::JobManager::instance().spawn_extract(std::move(options), err_fd);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_xayah_libnative_TarWrapper_poll(JNIEnv *, jobject, jlong job) {
+    return TarWrapperNS::JobManager::instance().poll(job);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_xayah_libnative_TarWrapper_waitFor(JNIEnv *, jobject, jlong job, jlong timeout_ms) {
+    return TarWrapperNS::JobManager::instance().wait(job, timeout_ms);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_xayah_libnative_TarWrapper_cancel(JNIEnv *, jobject, jlong job) {
+    return TarWrapperNS::JobManager::instance().cancel(job);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_xayah_libnative_TarWrapper_cancelAll(JNIEnv *, jobject) {
+    TarWrapperNS::JobManager::instance().cancel_all();
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_xayah_libnative_TarWrapper_release(JNIEnv *, jobject, jlong job) {
+    TarWrapperNS::JobManager::instance().release(job);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_xayah_libnative_TarWrapper_setMaxJobs(JNIEnv *, jobject, jint max_jobs) {
+    TarWrapperNS::JobManager::instance().set_max_running(max_jobs > 0 ? max_jobs : 1);
 }
@@ -0,0 +1,168 @@
+#include "content_hash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <android/log.h>
+#include "trace.h"
+
+#define LOG_TAG "NativeLib"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace NativeNS {
+    namespace {
+        constexpr size_t HASH_CHUNK_SIZE = 4 * 1024 * 1024;
+        constexpr size_t READ_BUFFER_SIZE = 256 * 1024;
+
+        struct HashedFile {
+            uint64_t size = 0;
+            std::vector<Sha256::Digest> chunk_digests;
+            std::atomic<bool> failed{false};
+        };
+
+        struct ChunkTask {
+            size_t file;
+            size_t chunk;
+        };
+
+        bool stat_file(const std::string &path, HashedFile &file) {
+            struct stat st{};
+            if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+                ALOGE("Failed to stat '%s' or not a regular file.", path.c_str());
+                return false;
+            }
+            file.size = static_cast<uint64_t>(st.st_size);
+            file.chunk_digests.resize((file.size + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE);
+            return true;
+        }
+
+        /**
+         * Reads and hashes a single chunk, fails if the file no longer has the size the task was planned for.
+         * pread() rather than mmap(), a file truncated meanwhile ends the read instead of raising SIGBUS.
+         */
+        bool hash_chunk(const std::string &path, HashedFile &file, size_t chunk, std::vector<uint8_t> &buffer) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1) {
+                ALOGE("Failed to open '%s': %s", path.c_str(), strerror(errno));
+                return false;
+            }
+            struct stat st{};
+            if (fstat(fd, &st) == -1 || static_cast<uint64_t>(st.st_size) != file.size) {
+                ALOGE("'%s' changed while being hashed.", path.c_str());
+                close(fd);
+                return false;
+            }
+            uint64_t offset = chunk * HASH_CHUNK_SIZE;
+            uint64_t remaining = std::min<uint64_t>(HASH_CHUNK_SIZE, file.size - offset);
+            posix_fadvise64(fd, static_cast<off64_t>(offset), static_cast<off64_t>(remaining), POSIX_FADV_SEQUENTIAL);
+            Sha256 sha;
+            while (remaining > 0) {
+                ssize_t nread = pread64(fd, buffer.data(), std::min<uint64_t>(buffer.size(), remaining), static_cast<off64_t>(offset));
+                if (nread == -1 && errno == EINTR) continue;
+                if (nread <= 0) {
+                    if (nread == 0) {
+                        ALOGE("'%s' changed while being hashed.", path.c_str());
+                    } else {
+                        ALOGE("Failed to read '%s': %s", path.c_str(), strerror(errno));
+                    }
+                    close(fd);
+                    return false;
+                }
+                sha.update(buffer.data(), static_cast<size_t>(nread));
+                offset += static_cast<uint64_t>(nread);
+                remaining -= static_cast<uint64_t>(nread);
+            }
+            close(fd);
+            file.chunk_digests[chunk] = sha.finish();
+            return true;
+        }
+
+        Sha256::Digest combine_chunks(const HashedFile &file) {
+            uint8_t size[8];
+            for (int i = 0; i < 8; i++) {
+                size[i] = static_cast<uint8_t>(file.size >> (56 - i * 8));
+            }
+            Sha256 sha;
+            sha.update(size, sizeof(size));
+            for (const auto &digest: file.chunk_digests) {
+                sha.update(digest.data(), digest.size());
+            }
+            return sha.finish();
+        }
+    }
+
+    std::string ContentHash::id() const {
+        char buffer[Sha256::DIGEST_SIZE * 2 + 32];
+        for (size_t i = 0; i < digest.size(); i++) {
+            snprintf(buffer + i * 2, 3, "%02x", digest[i]);
+        }
+        snprintf(buffer + digest.size() * 2, sizeof(buffer) - digest.size() * 2, "-%" PRIu64, size);
+        return buffer;
+    }
+
+    void hash_files(const std::vector<std::string> &paths, std::vector<ContentHash> &hashes, std::vector<bool> &failed) {
+        TraceNS::Span span("hash.files");
+        hashes.assign(paths.size(), ContentHash{});
+        failed.assign(paths.size(), false);
+
+        std::vector<HashedFile> files(paths.size());
+        std::vector<ChunkTask> tasks;
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!stat_file(paths[i], files[i])) {
+                files[i].failed = true;
+                continue;
+            }
+            for (size_t chunk = 0; chunk < files[i].chunk_digests.size(); chunk++) {
+                tasks.push_back(ChunkTask{i, chunk});
+            }
+        }
+
+        std::atomic<size_t> next{0};
+        auto worker = [&paths, &files, &tasks, &next]() {
+            TraceNS::Span span("hash.worker");
+            std::vector<uint8_t> buffer(READ_BUFFER_SIZE);
+            uint64_t hashed = 0;
+            size_t index;
+            while ((index = next.fetch_add(1, std::memory_order_relaxed)) < tasks.size()) {
+                HashedFile &file = files[tasks[index].file];
+                if (file.failed.load(std::memory_order_relaxed)) continue;
+                if (!hash_chunk(paths[tasks[index].file], file, tasks[index].chunk, buffer)) {
+                    file.failed = true;
+                    continue;
+                }
+                hashed += std::min<uint64_t>(HASH_CHUNK_SIZE, file.size - tasks[index].chunk * HASH_CHUNK_SIZE);
+            }
+            TraceNS::add(TraceNS::BYTES_HASHED, hashed);
+        };
+        size_t threads = std::min<size_t>(std::max<size_t>(1, std::thread::hardware_concurrency()), std::max<size_t>(1, tasks.size()));
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for (size_t i = 1; i < threads; i++) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: workers) {
+            thread.join();
+        }
+
+        for (size_t i = 0; i < files.size(); i++) {
+            if (files[i].failed) {
+                failed[i] = true;
+                continue;
+            }
+            hashes[i].digest = combine_chunks(files[i]);
+            hashes[i].size = files[i].size;
+        }
+    }
+}
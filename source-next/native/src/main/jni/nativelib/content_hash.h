@@ -0,0 +1,32 @@
+#ifndef NATIVELIB_CONTENT_HASH_H
+#define NATIVELIB_CONTENT_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sha256.h"
+
+namespace NativeNS {
+    struct ContentHash {
+        Sha256::Digest digest{};
+        uint64_t size = 0;
+
+        /**
+         * Returns "<digest as 64 hex digits>-<size>", used as the object name in content addressed stores.
+         */
+        std::string id() const;
+    };
+
+    /**
+     * Hashes all `paths` on a shared thread pool.
+     *
+     * Files are split into fixed size chunks hashed with SHA-256 independently, so a single large
+     * file still uses all cores. Chunks are read through a small per thread buffer, so memory use is
+     * bounded by the number of threads rather than the size of the input. The digest of a file
+     * is the SHA-256 of its size (8 bytes, big endian) followed by its chunk digests.
+     * `failed[i]` is set when file `i` could not be read or changed its size while being hashed.
+     */
+    void hash_files(const std::vector<std::string> &paths, std::vector<ContentHash> &hashes, std::vector<bool> &failed);
+}
+
+#endif //NATIVELIB_CONTENT_HASH_H
@@ -0,0 +1,278 @@
+#include "manifest.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <android/log.h>
+#include "trace.h"
+#include "tree_walker.h"
+
+#define LOG_TAG "NativeLib"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace NativeNS {
+    namespace {
+        constexpr char MANIFEST_MAGIC[4] = {'D', 'B', 'M', 'F'};
+        constexpr uint32_t MANIFEST_VERSION = 2;
+        constexpr const char *PENDING_SUFFIX = ".pending";
+        constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+        constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+        struct ManifestHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t count;
+            uint64_t settings_hash;
+        };
+
+        static_assert(sizeof(ManifestHeader) == 24, "ManifestHeader must stay 24 bytes");
+        static_assert(sizeof(ManifestEntry) == 40, "ManifestEntry must stay 40 bytes");
+
+        uint64_t fnv1a(uint64_t hash, const char *str) {
+            for (; *str != '\0'; str++) {
+                hash ^= static_cast<unsigned char>(*str);
+                hash *= FNV_PRIME;
+            }
+            return hash;
+        }
+
+        /**
+         * An entry with the path it was hashed from, kept for the diff log only.
+         */
+        struct ScannedEntry {
+            ManifestEntry entry;
+            std::string path;
+        };
+
+        /**
+         * Collects an entry per visited path into per-worker vectors, merged once the walk is done.
+         */
+        class ManifestVisitor : public TreeVisitor {
+        public:
+            explicit ManifestVisitor(size_t workers) : mEntries(workers) {}
+
+            void on_entry(size_t worker, size_t, int, const std::string &dir, const char *name, const struct stat &st) override {
+                // Same bytes as hashing "<dir>/<name>", without building the path.
+                uint64_t hash = fnv1a(FNV_OFFSET_BASIS, dir.c_str());
+                if (name != nullptr) {
+                    hash = fnv1a(hash, "/");
+                    hash = fnv1a(hash, name);
+                }
+                mEntries[worker].push_back(ScannedEntry{
+                        ManifestEntry{
+                                hash,
+                                static_cast<uint64_t>(S_ISDIR(st.st_mode) ? 0 : st.st_size),
+                                static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+                                static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec,
+                                static_cast<uint64_t>(st.st_ino),
+                        },
+                        name != nullptr ? dir + "/" + name : dir,
+                });
+            }
+
+            std::vector<ScannedEntry> take_sorted() {
+                std::vector<ScannedEntry> entries;
+                size_t total = 0;
+                for (auto &worker: mEntries) total += worker.size();
+                entries.reserve(total);
+                for (auto &worker: mEntries) {
+                    std::move(worker.begin(), worker.end(), std::back_inserter(entries));
+                    std::vector<ScannedEntry>().swap(worker);
+                }
+                std::sort(entries.begin(), entries.end(), [](const ScannedEntry &a, const ScannedEntry &b) {
+                    return a.entry.path_hash < b.entry.path_hash;
+                });
+                return entries;
+            }
+
+        private:
+            std::vector<std::vector<ScannedEntry>> mEntries;
+        };
+
+        /**
+         * Read-only mapping of a committed manifest, empty if it is missing or invalid.
+         */
+        class MappedManifest {
+        public:
+            explicit MappedManifest(const std::string &path) {
+                int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd == -1) {
+                    if (errno != ENOENT) ALOGW("Failed to open '%s': %s", path.c_str(), strerror(errno));
+                    return;
+                }
+                struct stat st{};
+                if (fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(ManifestHeader))) {
+                    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr != MAP_FAILED) {
+                        mAddr = addr;
+                        mLength = st.st_size;
+                    }
+                }
+                close(fd);
+                if (mAddr == nullptr) return;
+
+                auto *header = static_cast<const ManifestHeader *>(mAddr);
+                if (memcmp(header->magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0 || header->version != MANIFEST_VERSION ||
+                    header->count != (mLength - sizeof(ManifestHeader)) / sizeof(ManifestEntry)) {
+                    ALOGW("Ignoring invalid manifest '%s'.", path.c_str());
+                    return;
+                }
+                mEntries = reinterpret_cast<const ManifestEntry *>(static_cast<const char *>(mAddr) + sizeof(ManifestHeader));
+                mCount = header->count;
+                mSettingsHash = header->settings_hash;
+            }
+
+            ~MappedManifest() {
+                if (mAddr != nullptr) munmap(mAddr, mLength);
+            }
+
+            MappedManifest(const MappedManifest &) = delete;
+
+            MappedManifest &operator=(const MappedManifest &) = delete;
+
+            const ManifestEntry *entries() const { return mEntries; }
+
+            size_t count() const { return mCount; }
+
+            bool valid() const { return mEntries != nullptr; }
+
+            uint64_t settings_hash() const { return mSettingsHash; }
+
+        private:
+            void *mAddr = nullptr;
+            size_t mLength = 0;
+            const ManifestEntry *mEntries = nullptr;
+            size_t mCount = 0;
+            uint64_t mSettingsHash = 0;
+        };
+
+        bool write_fully(int fd, const void *data, size_t size) {
+            auto *bytes = static_cast<const char *>(data);
+            while (size > 0) {
+                ssize_t written = write(fd, bytes, size);
+                if (written == -1) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                bytes += written;
+                size -= written;
+            }
+            return true;
+        }
+
+        bool write_manifest(const std::string &path, const std::vector<ManifestEntry> &entries, uint64_t settings_hash) {
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if (fd == -1) {
+                ALOGE("Failed to open '%s': %s", path.c_str(), strerror(errno));
+                return false;
+            }
+            ManifestHeader header{};
+            memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+            header.version = MANIFEST_VERSION;
+            header.count = entries.size();
+            header.settings_hash = settings_hash;
+            bool written = write_fully(fd, &header, sizeof(header)) &&
+                           write_fully(fd, entries.data(), entries.size() * sizeof(ManifestEntry));
+            if (!written) {
+                ALOGE("Failed to write '%s': %s", path.c_str(), strerror(errno));
+            }
+            close(fd);
+            if (!written) unlink(path.c_str());
+            return written;
+        }
+
+        bool same_entry(const ManifestEntry &a, const ManifestEntry &b) {
+            return a.size == b.size && a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns && a.ino == b.ino;
+        }
+
+        void note_path(ManifestDiff &diff, const char *prefix, const std::string &path) {
+            if (diff.changed_paths.size() < ManifestDiff::MAX_CHANGED_PATHS) {
+                diff.changed_paths.push_back(prefix + path);
+            }
+        }
+
+        void diff_entries(const ManifestEntry *old_entries, size_t old_count, const std::vector<ScannedEntry> &new_entries,
+                          ManifestDiff &diff) {
+            size_t i = 0, j = 0;
+            while (i < old_count && j < new_entries.size()) {
+                const ManifestEntry &old_entry = old_entries[i];
+                const ScannedEntry &new_entry = new_entries[j];
+                if (old_entry.path_hash < new_entry.entry.path_hash) {
+                    diff.removed++;
+                    i++;
+                } else if (new_entry.entry.path_hash < old_entry.path_hash) {
+                    diff.added++;
+                    note_path(diff, "+ ", new_entry.path);
+                    j++;
+                } else {
+                    if (!same_entry(old_entry, new_entry.entry)) {
+                        diff.modified++;
+                        note_path(diff, "~ ", new_entry.path);
+                    }
+                    i++;
+                    j++;
+                }
+            }
+            diff.removed += static_cast<int64_t>(old_count - i);
+            for (; j < new_entries.size(); j++) {
+                diff.added++;
+                note_path(diff, "+ ", new_entries[j].path);
+            }
+        }
+    }
+
+    std::string pending_manifest_path(const std::string &manifest_path) {
+        return manifest_path + PENDING_SUFFIX;
+    }
+
+    bool scan_manifest(const std::string &manifest_path, const std::vector<std::string> &roots, const std::string &settings,
+                       ManifestDiff &diff) {
+        TraceNS::Span span("manifest.scan");
+        ManifestVisitor visitor(walker_thread_count(roots.size()));
+        std::vector<bool> failed;
+        walk_trees(roots, visitor, failed);
+        if (std::find(failed.begin(), failed.end(), true) != failed.end()) {
+            return false;
+        }
+        std::vector<ScannedEntry> scanned = visitor.take_sorted();
+        uint64_t settings_hash = fnv1a(FNV_OFFSET_BASIS, settings.c_str());
+
+        diff = ManifestDiff();
+        MappedManifest committed(manifest_path);
+        if (committed.valid() && committed.settings_hash() != settings_hash) {
+            diff.settings_changed = true;
+            diff.removed = static_cast<int64_t>(committed.count());
+            diff_entries(nullptr, 0, scanned, diff);
+        } else {
+            diff_entries(committed.entries(), committed.count(), scanned, diff);
+        }
+
+        std::vector<ManifestEntry> entries;
+        entries.reserve(scanned.size());
+        for (const auto &entry: scanned) entries.push_back(entry.entry);
+        std::vector<ScannedEntry>().swap(scanned);
+        return write_manifest(pending_manifest_path(manifest_path), entries, settings_hash);
+    }
+
+    bool commit_manifest(const std::string &manifest_path) {
+        if (rename(pending_manifest_path(manifest_path).c_str(), manifest_path.c_str()) == -1) {
+            ALOGE("Failed to commit manifest '%s': %s", manifest_path.c_str(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void discard_manifest(const std::string &manifest_path) {
+        unlink(pending_manifest_path(manifest_path).c_str());
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef NATIVELIB_MANIFEST_H
+#define NATIVELIB_MANIFEST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace NativeNS {
+    /**
+     * One entry below the archived roots, 40 bytes on disk.
+     * Entries are sorted by `path_hash` so two manifests diff in a single merge pass.
+     */
+    struct ManifestEntry {
+        uint64_t path_hash;
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t ctime_ns;
+        uint64_t ino;
+    };
+
+    struct ManifestDiff {
+        /** At most this many changed paths are kept in `changed_paths`. */
+        static constexpr size_t MAX_CHANGED_PATHS = 256;
+
+        int64_t added = 0;
+        int64_t removed = 0;
+        int64_t modified = 0;
+        /** Whether the committed manifest was written for other archive settings, every entry then counts as added. */
+        bool settings_changed = false;
+        /**
+         * Added and modified paths prefixed by "+ " or "~ ", removed entries are only known by their
+         * path hash and not listed.
+         */
+        std::vector<std::string> changed_paths;
+
+        int64_t changes() const { return added + removed + modified; }
+    };
+
+    /**
+     * Returns where scan_manifest() stages the manifest for `manifest_path`.
+     */
+    std::string pending_manifest_path(const std::string &manifest_path);
+
+    /**
+     * Walks `roots` into a new manifest staged next to `manifest_path` and diffs it against
+     * the manifest committed there, which is mmap'ed read-only. `settings` describes how the
+     * archive is written (e.g. its compression levels) and is stored as a hash in the manifest.
+     * A missing or invalid committed manifest, or one written for other settings, counts every
+     * entry as added. Returns false if a root could not be walked or the staged manifest could
+     * not be written.
+     */
+    bool scan_manifest(const std::string &manifest_path, const std::vector<std::string> &roots, const std::string &settings,
+                       ManifestDiff &diff);
+
+    /**
+     * Replaces the committed manifest with the staged one, call once the backup it describes succeeded.
+     */
+    bool commit_manifest(const std::string &manifest_path);
+
+    /**
+     * Drops the staged manifest, the committed one stays in place.
+     */
+    void discard_manifest(const std::string &manifest_path);
+}
+
+#endif //NATIVELIB_MANIFEST_H
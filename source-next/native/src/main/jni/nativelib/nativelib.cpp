@@ -1,10 +1,21 @@
 #include <jni.h>
 #include <string>
-#include <ftw.h>
+#include <string_view>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 #include <sys/stat.h>
 #include <climits>
-#include <fts.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 #include <android/log.h>
+#include "content_hash.h"
+#include "manifest.h"
+#include "nativelib.h"
+#include "tree_walker.h"
 
 #define LOG_TAG "NativeLib"
 #define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
@@ -13,34 +24,135 @@
 #define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
+namespace {
+    std::vector<std::string> read_string_array(JNIEnv *env, jobjectArray array) {
+        std::vector<std::string> strings;
+        jsize count = env->GetArrayLength(array);
+        strings.reserve(count);
+        for (int i = 0; i < count; i++) {
+            auto str = (jstring) env->GetObjectArrayElement(array, i);
+            const char *utf = env->GetStringUTFChars(str, nullptr);
+            strings.emplace_back(utf);
+            env->ReleaseStringUTFChars(str, utf);
+            env->DeleteLocalRef(str);
+        }
+        return strings;
+    }
+}
+
 namespace NativeNS {
     /**
+     * Sums st_blocks of every entry below each root, hard links are counted once per root.
+     */
+    class TreeSizeVisitor : public TreeVisitor {
+    public:
+        explicit TreeSizeVisitor(size_t roots) : mSizes(roots), mInodes(roots) {}
+
+        void on_entry(size_t, size_t root, int, const std::string &, const char *, const struct stat &st) override {
+            if (!S_ISDIR(st.st_mode) && st.st_nlink > 1) {
+                auto &inodes = mInodes[root];
+                std::lock_guard<std::mutex> guard(inodes.lock);
+                if (!inodes.seen.emplace(st.st_dev, st.st_ino).second) return;
+            }
+            mSizes[root].fetch_add(st.st_blocks * 512, std::memory_order_relaxed);
+        }
+
+        int64_t size(size_t root) const {
+            return mSizes[root].load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct InodeHash {
+            size_t operator()(const std::pair<dev_t, ino_t> &key) const {
+                return std::hash<uint64_t>()((uint64_t) key.second * 31 + (uint64_t) key.first);
+            }
+        };
+
+        struct InodeSet {
+            std::mutex lock;
+            std::unordered_set<std::pair<dev_t, ino_t>, InodeHash> seen;
+        };
+
+        std::vector<std::atomic<int64_t>> mSizes;
+        std::vector<InodeSet> mInodes;
+    };
+
+    /**
+     * Batch version of installd's calculate_tree_size, all roots are walked in parallel.
      * https://cs.android.com/android/platform/superproject/+/android-15.0.0_r23:frameworks/native/cmds/installd/utils.cpp;l=467
      */
-    int calculate_tree_size(const std::string &path, int64_t *size) {
-        FTS *fts;
-        FTSENT *p;
-        int64_t matchedSize = 0;
-        char *argv[] = {(char *) path.c_str(), nullptr};
-        if (!(fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr))) {
-            if (errno != ENOENT) {
-                ALOGE("Failed to fts_open '%s'", path.c_str());
+    void calculate_tree_sizes(const std::vector<std::string> &paths, std::vector<int64_t> &sizes, std::vector<bool> &failed) {
+        TreeSizeVisitor visitor(paths.size());
+        walk_trees(paths, visitor, failed);
+        sizes.resize(paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            sizes[i] = visitor.size(i);
+        }
+    }
+
+    /**
+     * Restores app ownership below a freshly extracted tree in a single pass, entries that already
+     * match are left alone. Like installd, the top level cache and code_cache directories and
+     * everything below them get `cache_gid`. setuid/setgid bits are dropped from everything but directories.
+     */
+    class OwnershipVisitor : public TreeVisitor {
+    public:
+        OwnershipVisitor(const std::string &root, uid_t uid, gid_t gid, gid_t cache_gid)
+                : mRoot(root), mUid(uid), mGid(gid), mCacheGid(cache_gid) {
+            while (mRoot.size() > 1 && mRoot.back() == '/') mRoot.pop_back();
+        }
+
+        void on_entry(size_t, size_t, int dir_fd, const std::string &dir, const char *name, const struct stat &st) override {
+            const char *target = name != nullptr ? name : dir.c_str();
+            gid_t gid = name != nullptr && in_cache(dir, name) ? mCacheGid : mGid;
+            if ((st.st_uid != mUid || st.st_gid != gid) && fchownat(dir_fd, target, mUid, gid, AT_SYMLINK_NOFOLLOW) == -1) {
+                ALOGW("Failed to chown '%s/%s': %s", dir.c_str(), name != nullptr ? name : "", strerror(errno));
+                mFailures.fetch_add(1, std::memory_order_relaxed);
             }
-            return -1;
+            if (!S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode) && (st.st_mode & (S_ISUID | S_ISGID)) != 0 &&
+                fchmodat(dir_fd, target, st.st_mode & 07777 & ~(S_ISUID | S_ISGID), 0) == -1) {
+                ALOGW("Failed to chmod '%s/%s': %s", dir.c_str(), name != nullptr ? name : "", strerror(errno));
+                mFailures.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        int failures() const {
+            return mFailures.load(std::memory_order_relaxed);
         }
-        while ((p = fts_read(fts)) != nullptr) {
-            switch (p->fts_info) {
-                case FTS_D:
-                case FTS_DEFAULT:
-                case FTS_F:
-                case FTS_SL:
-                case FTS_SLNONE:
-                    matchedSize += (p->fts_statp->st_blocks * 512);
-                    break;
+
+    private:
+        std::string mRoot;
+        uid_t mUid;
+        gid_t mGid;
+        gid_t mCacheGid;
+        std::atomic<int> mFailures{0};
+
+        // Whether `dir`/`name` is a top level cache directory or below one.
+        bool in_cache(const std::string &dir, const char *name) const {
+            std::string_view top = name;
+            if (dir.size() > mRoot.size()) {
+                top = std::string_view(dir).substr(mRoot.size() + 1);
+                top = top.substr(0, top.find('/'));
             }
+            return top == "cache" || top == "code_cache";
+        }
+    };
+
+    int fix_tree_ownership(const std::string &path, uid_t uid, gid_t gid, gid_t cache_gid) {
+        OwnershipVisitor visitor(path, uid, gid, cache_gid);
+        std::vector<bool> failed;
+        walk_trees({path}, visitor, failed);
+        return failed[0] ? -1 : visitor.failures();
+    }
+
+    int calculate_tree_size(const std::string &path, int64_t *size) {
+        std::vector<int64_t> sizes;
+        std::vector<bool> failed;
+        calculate_tree_sizes({path}, sizes, failed);
+        if (failed[0]) {
+            return -1;
         }
-        fts_close(fts);
-        *size += matchedSize;
+        *size += sizes[0];
         return 0;
     }
 }
@@ -48,12 +160,36 @@ namespace NativeNS {
 extern "C" JNIEXPORT jlong JNICALL
 Java_com_xayah_libnative_NativeLib_calculateTreeSize(JNIEnv *env, jobject, jstring path) {
     int64_t total_size = 0;
-    int64_t *p_total_size = &total_size;
     const char *p_path = env->GetStringUTFChars(path, JNI_FALSE);
-    NativeNS::calculate_tree_size(p_path, p_total_size);
+    NativeNS::calculate_tree_size(p_path, &total_size);
+    env->ReleaseStringUTFChars(path, p_path);
     return total_size;
 }
 
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_xayah_libnative_NativeLib_calculateTreeSizes(JNIEnv *env, jobject, jobjectArray j_paths) {
+    std::vector<std::string> paths = read_string_array(env, j_paths);
+    auto count = static_cast<jsize>(paths.size());
+
+    std::vector<int64_t> sizes;
+    std::vector<bool> failed;
+    NativeNS::calculate_tree_sizes(paths, sizes, failed);
+
+    jlongArray result = env->NewLongArray(count);
+    if (result != nullptr) {
+        env->SetLongArrayRegion(result, 0, count, reinterpret_cast<const jlong *>(sizes.data()));
+    }
+    return result;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_xayah_libnative_NativeLib_fixOwnership(JNIEnv *env, jobject, jstring path, jint uid, jint gid, jint cache_gid) {
+    const char *p_path = env->GetStringUTFChars(path, nullptr);
+    int result = NativeNS::fix_tree_ownership(p_path, (uid_t) uid, (gid_t) gid, (gid_t) cache_gid);
+    env->ReleaseStringUTFChars(path, p_path);
+    return result;
+}
+
 extern "C" JNIEXPORT jintArray JNICALL
 Java_com_xayah_libnative_NativeLib_getUidGid(JNIEnv *env, jobject, jstring path) {
     struct stat file_stat{};
@@ -70,3 +206,68 @@ Java_com_xayah_libnative_NativeLib_getUidGid(JNIEnv *env, jobject, jstring path)
     env->ReleaseIntArrayElements(result, p_result, 0);
     return result;
 }
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_xayah_libnative_NativeLib_scanManifest(JNIEnv *env, jobject, jstring manifest_path, jobjectArray j_roots, jstring j_settings) {
+    std::vector<std::string> roots = read_string_array(env, j_roots);
+
+    const char *p_path = env->GetStringUTFChars(manifest_path, nullptr);
+    std::string path = p_path;
+    env->ReleaseStringUTFChars(manifest_path, p_path);
+
+    const char *p_settings = env->GetStringUTFChars(j_settings, nullptr);
+    std::string settings = p_settings;
+    env->ReleaseStringUTFChars(j_settings, p_settings);
+
+    NativeNS::ManifestDiff diff;
+    if (!NativeNS::scan_manifest(path, roots, settings, diff)) {
+        return -1;
+    }
+    if (diff.settings_changed) {
+        ALOGI("Manifest '%s' was written for other archive settings, now '%s'.", path.c_str(), settings.c_str());
+    }
+    ALOGD("Manifest '%s': %lld added, %lld removed, %lld modified.", path.c_str(),
+          (long long) diff.added, (long long) diff.removed, (long long) diff.modified);
+    for (const auto &changed: diff.changed_paths) {
+        ALOGD("  %s", changed.c_str());
+    }
+    auto listed = static_cast<int64_t>(diff.changed_paths.size());
+    if (diff.added + diff.modified > listed) {
+        ALOGD("  ... and %lld more added or modified.", (long long) (diff.added + diff.modified - listed));
+    }
+    return diff.changes();
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_xayah_libnative_NativeLib_commitManifest(JNIEnv *env, jobject, jstring manifest_path) {
+    const char *p_path = env->GetStringUTFChars(manifest_path, nullptr);
+    bool result = NativeNS::commit_manifest(p_path);
+    env->ReleaseStringUTFChars(manifest_path, p_path);
+    return result;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_xayah_libnative_NativeLib_discardManifest(JNIEnv *env, jobject, jstring manifest_path) {
+    const char *p_path = env->GetStringUTFChars(manifest_path, nullptr);
+    NativeNS::discard_manifest(p_path);
+    env->ReleaseStringUTFChars(manifest_path, p_path);
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_xayah_libnative_NativeLib_hashFiles(JNIEnv *env, jobject, jobjectArray j_paths) {
+    std::vector<std::string> paths = read_string_array(env, j_paths);
+    auto count = static_cast<jsize>(paths.size());
+
+    std::vector<NativeNS::ContentHash> hashes;
+    std::vector<bool> failed;
+    NativeNS::hash_files(paths, hashes, failed);
+
+    jobjectArray result = env->NewObjectArray(count, env->FindClass("java/lang/String"), nullptr);
+    if (result == nullptr) return nullptr;
+    for (int i = 0; i < count; i++) {
+        jstring id = env->NewStringUTF(failed[i] ? "" : hashes[i].id().c_str());
+        env->SetObjectArrayElement(result, i, id);
+        env->DeleteLocalRef(id);
+    }
+    return result;
+}
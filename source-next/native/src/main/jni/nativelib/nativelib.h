@@ -0,0 +1,24 @@
+#ifndef NATIVELIB_NATIVELIB_H
+#define NATIVELIB_NATIVELIB_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace NativeNS {
+    /**
+     * Adds the size of everything below `path` to `*size` like installd does, returns -1 if `path` is missing.
+     */
+    int calculate_tree_size(const std::string &path, int64_t *size);
+
+    void calculate_tree_sizes(const std::vector<std::string> &paths, std::vector<int64_t> &sizes, std::vector<bool> &failed);
+
+    /**
+     * Chowns everything below `path` to `uid`:`gid`, the top level cache and code_cache trees to
+     * `uid`:`cache_gid`. Returns the number of entries that could not be fixed, or -1 if `path` is missing.
+     */
+    int fix_tree_ownership(const std::string &path, uid_t uid, gid_t gid, gid_t cache_gid);
+}
+
+#endif //NATIVELIB_NATIVELIB_H
@@ -0,0 +1,178 @@
+#include "sha256.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <android/log.h>
+#include "sha256_compress.h"
+
+#define LOG_TAG "NativeLib"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace NativeNS {
+    const uint32_t SHA256_ROUND_CONSTANTS[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    namespace {
+        constexpr uint32_t INITIAL_STATE[8] = {
+                0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+
+        struct KnownAnswer {
+            const char *message;
+            // Repetitions of `message`.
+            size_t count;
+            const char *digest;
+        };
+
+        // FIPS 180-4 examples (one block, two blocks, long message).
+        constexpr KnownAnswer KNOWN_ANSWERS[] = {
+                {"", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+                {"abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+                {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+                 "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+                {"a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+        };
+
+        inline uint32_t rotr(uint32_t x, int n) {
+            return (x >> n) | (x << (32 - n));
+        }
+    }
+
+    void sha256_compress_portable(uint32_t *state, const uint8_t *data, size_t blocks) {
+        for (; blocks > 0; blocks--, data += 64) {
+            uint32_t w[64];
+            for (int i = 0; i < 16; i++) {
+                w[i] = static_cast<uint32_t>(data[i * 4]) << 24 | static_cast<uint32_t>(data[i * 4 + 1]) << 16 |
+                       static_cast<uint32_t>(data[i * 4 + 2]) << 8 | static_cast<uint32_t>(data[i * 4 + 3]);
+            }
+            for (int i = 16; i < 64; i++) {
+                uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int i = 0; i < 64; i++) {
+                uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_ROUND_CONSTANTS[i] + w[i];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+    }
+
+    Sha256::Sha256() : Sha256(select_compress()) {}
+
+    Sha256::Sha256(Compress compress) : mCompress(compress) {
+        memcpy(mState, INITIAL_STATE, sizeof(mState));
+    }
+
+    Sha256::Compress Sha256::select_compress() {
+        static Compress selected = [] {
+#ifdef NATIVELIB_SHA256_ARMV8
+            if (sha256_armv8_supported()) {
+                if (known_answers_match(sha256_compress_armv8)) return sha256_compress_armv8;
+                ALOGE("ARMv8 SHA-256 failed the self test, using the portable one.");
+            }
+#endif
+#ifdef NATIVELIB_SHA256_SHANI
+            if (sha256_shani_supported()) {
+                if (known_answers_match(sha256_compress_shani)) return sha256_compress_shani;
+                ALOGE("SHA-NI SHA-256 failed the self test, using the portable one.");
+            }
+#endif
+            return sha256_compress_portable;
+        }();
+        return selected;
+    }
+
+    bool Sha256::known_answers_match(Compress compress) {
+        for (const auto &answer: KNOWN_ANSWERS) {
+            Sha256 sha(compress);
+            for (size_t i = 0; i < answer.count; i++) {
+                sha.update(answer.message, strlen(answer.message));
+            }
+            Digest digest = sha.finish();
+            char hex[DIGEST_SIZE * 2 + 1];
+            for (size_t i = 0; i < digest.size(); i++) {
+                snprintf(hex + i * 2, 3, "%02x", digest[i]);
+            }
+            if (strcmp(hex, answer.digest) != 0) return false;
+        }
+        return true;
+    }
+
+    bool Sha256::self_test() {
+        return known_answers_match(select_compress());
+    }
+
+    void Sha256::update(const void *data, size_t length) {
+        auto *bytes = static_cast<const uint8_t *>(data);
+        mLength += length;
+        if (mBuffered != 0) {
+            size_t take = std::min(length, sizeof(mBuffer) - mBuffered);
+            memcpy(mBuffer + mBuffered, bytes, take);
+            mBuffered += take;
+            bytes += take;
+            length -= take;
+            if (mBuffered < sizeof(mBuffer)) return;
+            mCompress(mState, mBuffer, 1);
+            mBuffered = 0;
+        }
+        size_t blocks = length / sizeof(mBuffer);
+        if (blocks > 0) {
+            mCompress(mState, bytes, blocks);
+            bytes += blocks * sizeof(mBuffer);
+            length -= blocks * sizeof(mBuffer);
+        }
+        memcpy(mBuffer, bytes, length);
+        mBuffered = length;
+    }
+
+    Sha256::Digest Sha256::finish() {
+        uint64_t bits = mLength * 8;
+        uint8_t padding[sizeof(mBuffer) + 8] = {0x80};
+        size_t padding_length = (mBuffered < 56 ? 56 : 120) - mBuffered;
+        for (int i = 0; i < 8; i++) {
+            padding[padding_length + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+        }
+        update(padding, padding_length + 8);
+
+        Digest digest{};
+        for (int i = 0; i < 8; i++) {
+            digest[i * 4] = static_cast<uint8_t>(mState[i] >> 24);
+            digest[i * 4 + 1] = static_cast<uint8_t>(mState[i] >> 16);
+            digest[i * 4 + 2] = static_cast<uint8_t>(mState[i] >> 8);
+            digest[i * 4 + 3] = static_cast<uint8_t>(mState[i]);
+        }
+        return digest;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef NATIVELIB_SHA256_H
+#define NATIVELIB_SHA256_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace NativeNS {
+    /**
+     * Incremental SHA-256 (FIPS 180-4), the NDK exposes no libcrypto to link against.
+     * Blocks are compressed with the ARMv8 or x86 SHA instructions when the CPU has them.
+     */
+    class Sha256 {
+    public:
+        static constexpr size_t DIGEST_SIZE = 32;
+        using Digest = std::array<uint8_t, DIGEST_SIZE>;
+
+        Sha256();
+
+        void update(const void *data, size_t length);
+
+        /**
+         * Pads the message and returns its digest, the instance must not be updated afterwards.
+         */
+        Digest finish();
+
+        /**
+         * Checks the compression function in use against the FIPS 180-4 example digests. Accelerated
+         * ones are also checked before their first use and replaced by the portable one if they fail.
+         */
+        static bool self_test();
+
+    private:
+        using Compress = void (*)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+        explicit Sha256(Compress compress);
+
+        static Compress select_compress();
+
+        static bool known_answers_match(Compress compress);
+
+        Compress mCompress;
+        uint32_t mState[8];
+        uint8_t mBuffer[64];
+        size_t mBuffered = 0;
+        uint64_t mLength = 0;
+    };
+}
+
+#endif //NATIVELIB_SHA256_H
@@ -0,0 +1,38 @@
+#include "sha256_compress.h"
+
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+
+namespace NativeNS {
+    bool sha256_armv8_supported() {
+        return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+    }
+
+    void sha256_compress_armv8(uint32_t *state, const uint8_t *data, size_t blocks) {
+        uint32x4_t abcd = vld1q_u32(state);
+        uint32x4_t efgh = vld1q_u32(state + 4);
+        for (; blocks > 0; blocks--, data += 64) {
+            uint32x4_t abcd_saved = abcd;
+            uint32x4_t efgh_saved = efgh;
+            uint32x4_t w[4];
+            for (int i = 0; i < 4; i++) {
+                w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + i * 16)));
+            }
+            // Four rounds per step, the message schedule is kept in a ring of four vectors.
+            for (int i = 0; i < 16; i++) {
+                if (i >= 4) {
+                    w[i % 4] = vsha256su1q_u32(vsha256su0q_u32(w[i % 4], w[(i + 1) % 4]), w[(i + 2) % 4], w[(i + 3) % 4]);
+                }
+                uint32x4_t wk = vaddq_u32(w[i % 4], vld1q_u32(SHA256_ROUND_CONSTANTS + i * 4));
+                uint32x4_t abcd_prev = abcd;
+                abcd = vsha256hq_u32(abcd, efgh, wk);
+                efgh = vsha256h2q_u32(efgh, abcd_prev, wk);
+            }
+            abcd = vaddq_u32(abcd, abcd_saved);
+            efgh = vaddq_u32(efgh, efgh_saved);
+        }
+        vst1q_u32(state, abcd);
+        vst1q_u32(state + 4, efgh);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef NATIVELIB_SHA256_COMPRESS_H
+#define NATIVELIB_SHA256_COMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace NativeNS {
+    extern const uint32_t SHA256_ROUND_CONSTANTS[64];
+
+    /**
+     * Runs the SHA-256 compression function over `blocks` consecutive 64 byte blocks at `data`.
+     */
+    using Sha256Compress = void (*)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+    void sha256_compress_portable(uint32_t *state, const uint8_t *data, size_t blocks);
+
+#ifdef NATIVELIB_SHA256_ARMV8
+    // ARMv8 Cryptographic Extension, built with +crypto and only called if the CPU reports SHA2.
+    bool sha256_armv8_supported();
+
+    void sha256_compress_armv8(uint32_t *state, const uint8_t *data, size_t blocks);
+#endif
+
+#ifdef NATIVELIB_SHA256_SHANI
+    // Intel SHA extensions, built with -msha and only called if CPUID reports them.
+    bool sha256_shani_supported();
+
+    void sha256_compress_shani(uint32_t *state, const uint8_t *data, size_t blocks);
+#endif
+}
+
+#endif //NATIVELIB_SHA256_COMPRESS_H
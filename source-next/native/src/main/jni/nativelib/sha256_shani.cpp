@@ -0,0 +1,54 @@
+#include "sha256_compress.h"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+namespace NativeNS {
+    namespace {
+        inline __m128i schedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3) {
+            __m128i t = _mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4));
+            return _mm_sha256msg2_epu32(t, w3);
+        }
+    }
+
+    bool sha256_shani_supported() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+        bool ssse3 = (ecx & bit_SSSE3) != 0;
+        bool sse41 = (ecx & bit_SSE4_1) != 0;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+        return ssse3 && sse41 && (ebx & bit_SHA) != 0;
+    }
+
+    void sha256_compress_shani(uint32_t *state, const uint8_t *data, size_t blocks) {
+        const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        // The rounds instruction works on the state as ABEF and CDGH.
+        __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0xb1);
+        __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state + 4)), 0x1b);
+        __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+        __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+        for (; blocks > 0; blocks--, data += 64) {
+            __m128i abef_saved = abef;
+            __m128i cdgh_saved = cdgh;
+            __m128i w[4];
+            for (int i = 0; i < 4; i++) {
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), byte_swap);
+            }
+            // Four rounds per step, the message schedule is kept in a ring of four vectors.
+            for (int i = 0; i < 16; i++) {
+                if (i >= 4) {
+                    w[i % 4] = schedule(w[i % 4], w[(i + 1) % 4], w[(i + 2) % 4], w[(i + 3) % 4]);
+                }
+                __m128i wk = _mm_add_epi32(w[i % 4], _mm_loadu_si128(reinterpret_cast<const __m128i *>(SHA256_ROUND_CONSTANTS + i * 4)));
+                cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+                abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+            }
+            abef = _mm_add_epi32(abef, abef_saved);
+            cdgh = _mm_add_epi32(cdgh, cdgh_saved);
+        }
+        __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+        __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_blend_epi16(feba, dchg, 0xf0));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+    }
+}
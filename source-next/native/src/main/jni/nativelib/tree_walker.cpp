@@ -0,0 +1,247 @@
+#include "tree_walker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <android/log.h>
+#include "trace.h"
+
+#define LOG_TAG "NativeLib"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace NativeNS {
+    namespace {
+        constexpr size_t DENTS_BUFFER_SIZE = 64 * 1024;
+        constexpr int IDLE_SPINS_BEFORE_SLEEP = 64;
+        // Queued directories per running worker before another one is started.
+        constexpr int64_t PENDING_PER_WORKER = 16;
+
+        struct linux_dirent64 {
+            ino64_t d_ino;
+            off64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[];
+        };
+
+        /**
+         * Directory fd shared by the tasks of its subdirectories, which may run on other workers.
+         */
+        struct DirFd {
+            int fd;
+
+            explicit DirFd(int fd) : fd(fd) {}
+
+            ~DirFd() {
+                close(fd);
+            }
+        };
+
+        /**
+         * `parent` is null for a root, which is opened by `path`. Other directories are opened
+         * relative to their parent so deep paths are never resolved again.
+         */
+        struct WalkTask {
+            size_t root;
+            dev_t dev;
+            std::shared_ptr<DirFd> parent;
+            std::string path;
+            size_t name_offset;
+        };
+
+        /**
+         * The owner pushes and pops at the back so it walks depth-first with warm
+         * dentries, thieves take from the front where the largest subtrees usually are.
+         */
+        struct WorkerQueue {
+            std::mutex lock;
+            std::deque<WalkTask> tasks;
+        };
+
+        class Walker {
+        public:
+            Walker(TreeVisitor &visitor, size_t threads) : mVisitor(visitor), mQueues(threads) {}
+
+            void push(size_t worker, WalkTask &&task) {
+                int64_t pending = mPending.fetch_add(1, std::memory_order_relaxed) + 1;
+                {
+                    std::lock_guard<std::mutex> guard(mQueues[worker].lock);
+                    mQueues[worker].tasks.push_back(std::move(task));
+                }
+                if (pending > PENDING_PER_WORKER * static_cast<int64_t>(mStarted.load(std::memory_order_relaxed))) {
+                    start_worker();
+                }
+            }
+
+            /**
+             * Waits for the workers started while walking, the calling thread must have run as worker 0.
+             */
+            void join() {
+                std::lock_guard<std::mutex> guard(mThreadsLock);
+                for (auto &thread: mThreads) {
+                    thread.join();
+                }
+                mThreads.clear();
+            }
+
+            void run(size_t worker) {
+                TraceNS::Span span("walk.worker");
+                std::vector<char> buffer(DENTS_BUFFER_SIZE);
+                WalkTask task;
+                int idle = 0;
+                while (true) {
+                    if (pop(worker, task) || steal(worker, task)) {
+                        idle = 0;
+                        walk_dir(worker, task, buffer);
+                        mPending.fetch_sub(1, std::memory_order_acq_rel);
+                        continue;
+                    }
+                    if (mPending.load(std::memory_order_acquire) == 0) {
+                        break;
+                    }
+                    if (++idle < IDLE_SPINS_BEFORE_SLEEP) {
+                        std::this_thread::yield();
+                    } else {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    }
+                }
+            }
+
+        private:
+            TreeVisitor &mVisitor;
+            std::vector<WorkerQueue> mQueues;
+            std::atomic<int64_t> mPending{0};
+            // Worker 0 is the calling thread, the others start once enough directories are queued.
+            std::atomic<size_t> mStarted{1};
+            std::mutex mThreadsLock;
+            std::vector<std::thread> mThreads;
+
+            void start_worker() {
+                std::lock_guard<std::mutex> guard(mThreadsLock);
+                size_t worker = mStarted.load(std::memory_order_relaxed);
+                if (worker >= mQueues.size()) return;
+                mStarted.store(worker + 1, std::memory_order_relaxed);
+                mThreads.emplace_back(&Walker::run, this, worker);
+            }
+
+            bool pop(size_t worker, WalkTask &task) {
+                std::lock_guard<std::mutex> guard(mQueues[worker].lock);
+                auto &tasks = mQueues[worker].tasks;
+                if (tasks.empty()) return false;
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                return true;
+            }
+
+            bool steal(size_t worker, WalkTask &task) {
+                for (size_t i = 1; i < mQueues.size(); i++) {
+                    auto &victim = mQueues[(worker + i) % mQueues.size()];
+                    std::lock_guard<std::mutex> guard(victim.lock);
+                    if (victim.tasks.empty()) continue;
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    return true;
+                }
+                return false;
+            }
+
+            void walk_dir(size_t worker, const WalkTask &task, std::vector<char> &buffer) {
+                int fd = task.parent != nullptr
+                         ? openat(task.parent->fd, task.path.c_str() + task.name_offset, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                         : open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (fd == -1) {
+                    // fts reports an unreadable directory as FTS_D first, which installd counts, and
+                    // then as FTS_DNR without its contents. The parent already reported it here.
+                    if (errno != ENOENT) {
+                        ALOGW("Failed to open '%s': %s", task.path.c_str(), strerror(errno));
+                    }
+                    return;
+                }
+                auto dir = std::make_shared<DirFd>(fd);
+                struct stat st{};
+                uint64_t stat_calls = 0;
+                uint64_t entries = 0;
+                while (true) {
+                    long nread = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+                    if (nread <= 0) {
+                        if (nread == -1) {
+                            ALOGW("Failed to read '%s': %s", task.path.c_str(), strerror(errno));
+                        }
+                        break;
+                    }
+                    for (long offset = 0; offset < nread;) {
+                        auto *dirent = reinterpret_cast<linux_dirent64 *>(buffer.data() + offset);
+                        offset += dirent->d_reclen;
+                        const char *name = dirent->d_name;
+                        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                            continue;
+                        }
+                        stat_calls++;
+                        if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                            // Same as FTS_NS, nothing to account.
+                            continue;
+                        }
+                        entries++;
+                        mVisitor.on_entry(worker, task.root, fd, task.path, name, st);
+                        // FTS_XDEV: mount points are reported like any directory but not entered.
+                        if (S_ISDIR(st.st_mode) && st.st_dev == task.dev) {
+                            std::string child;
+                            child.reserve(task.path.size() + 1 + strlen(name));
+                            child.append(task.path).append("/").append(name);
+                            push(worker, WalkTask{task.root, task.dev, dir, std::move(child), task.path.size() + 1});
+                        }
+                    }
+                }
+                // Once per directory, the counters live in a per thread buffer anyway.
+                TraceNS::add(TraceNS::STAT_CALLS, stat_calls);
+                TraceNS::add(TraceNS::ENTRIES_VISITED, entries);
+            }
+        };
+    }
+
+    size_t walker_thread_count(size_t roots) {
+        if (roots == 0) return 1;
+        return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    void walk_trees(const std::vector<std::string> &roots, TreeVisitor &visitor, std::vector<bool> &failed) {
+        TraceNS::Span span("walk.trees");
+        size_t threads = walker_thread_count(roots.size());
+        Walker walker(visitor, threads);
+        failed.assign(roots.size(), false);
+
+        struct stat st{};
+        for (size_t i = 0; i < roots.size(); i++) {
+            if (lstat(roots[i].c_str(), &st) == -1) {
+                if (errno != ENOENT) {
+                    ALOGE("Failed to stat '%s': %s", roots[i].c_str(), strerror(errno));
+                }
+                failed[i] = true;
+                continue;
+            }
+            visitor.on_entry(0, i, AT_FDCWD, roots[i], nullptr, st);
+            if (S_ISDIR(st.st_mode)) {
+                std::string root = roots[i];
+                while (root.size() > 1 && root.back() == '/') root.pop_back();
+                walker.push(0, WalkTask{i, st.st_dev, nullptr, std::move(root), 0});
+            }
+        }
+
+        // The calling thread works as worker 0, small trees never start another one.
+        walker.run(0);
+        walker.join();
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef NATIVELIB_TREE_WALKER_H
+#define NATIVELIB_TREE_WALKER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+namespace NativeNS {
+    /**
+     * Receives every entry found by walk_trees().
+     *
+     * Callbacks run concurrently on the walker threads, `worker` is stable for
+     * the calling thread so implementations can keep per-worker state without locking.
+     * `dir_fd` is open on `dir` for *at() calls relative to `name`, for a root itself
+     * `dir_fd` is AT_FDCWD, `name` is nullptr and `dir` is the root path.
+     */
+    class TreeVisitor {
+    public:
+        virtual ~TreeVisitor() = default;
+
+        virtual void on_entry(size_t worker, size_t root, int dir_fd, const std::string &dir, const char *name, const struct stat &st) = 0;
+    };
+
+    /**
+     * Returns the most workers walk_trees() may use for `roots` roots, more are only
+     * started while enough directories are queued so small trees are walked inline.
+     */
+    size_t walker_thread_count(size_t roots);
+
+    /**
+     * Walks all `roots` in parallel on a work-stealing pool.
+     *
+     * Same rules as the fts based traversal it replaces (FTS_PHYSICAL | FTS_XDEV):
+     * symlinks are never followed and directories on another device are skipped.
+     * Directories are opened with openat() on their parent, never by full path.
+     * `failed[i]` is set when root `i` could not be stat'ed.
+     */
+    void walk_trees(const std::vector<std::string> &roots, TreeVisitor &visitor, std::vector<bool> &failed);
+}
+
+#endif //NATIVELIB_TREE_WALKER_H
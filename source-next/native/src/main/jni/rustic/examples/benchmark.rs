@@ -0,0 +1,102 @@
+//! Host benchmark of the rustic engine, run by the native benchmark (jni/benchmark) on its
+//! synthetic tree, or alone: `cargo run --release --example benchmark -- <source> <work> [repeat]`.
+//! Prints a JSON object with the timings in seconds.
+
+use std::error::Error;
+use std::fs;
+use std::path::Path;
+use std::time::Instant;
+
+const PASSWORD: &str = "benchmark";
+
+fn seconds<T>(body: impl FnOnce() -> rustic::Result<T>) -> Result<(f64, T), Box<dyn Error>> {
+    let start = Instant::now();
+    let value = body()?;
+    Ok((start.elapsed().as_secs_f64(), value))
+}
+
+fn median(mut values: Vec<f64>) -> f64 {
+    values.sort_by(f64::total_cmp);
+    let mid = values.len() / 2;
+    if values.len() % 2 == 1 {
+        values[mid]
+    } else {
+        (values[mid - 1] + values[mid]) / 2.0
+    }
+}
+
+fn subdirectories(source: &Path) -> Result<Vec<Vec<String>>, Box<dyn Error>> {
+    let mut sets = fs::read_dir(source)?
+        .filter_map(|entry| entry.ok())
+        .filter(|entry| entry.file_type().is_ok_and(|file_type| file_type.is_dir()))
+        .map(|entry| vec![entry.path().to_string_lossy().into_owned()])
+        .collect::<Vec<_>>();
+    sets.sort();
+    Ok(sets)
+}
+
+fn main() -> Result<(), Box<dyn Error>> {
+    let args = std::env::args().collect::<Vec<_>>();
+    if args.len() < 3 {
+        return Err(format!("usage: {} <source_dir> <work_dir> [repeat]", args[0]).into());
+    }
+    let source = Path::new(&args[1]);
+    let work = Path::new(&args[2]);
+    let repeat = args
+        .get(3)
+        .and_then(|value| value.parse::<usize>().ok())
+        .unwrap_or(3)
+        .max(1);
+    let sources = vec![source.to_string_lossy().into_owned()];
+    let tags = vec!["benchmark".to_string()];
+
+    if work.exists() {
+        fs::remove_dir_all(work)?;
+    }
+    fs::create_dir_all(work)?;
+    let repository = work.join("repository");
+    let repository_path = repository.to_str().ok_or("work_dir is not UTF-8")?;
+
+    let (init, ()) = seconds(|| rustic::init_repository(repository_path, PASSWORD))?;
+    let (cold, snapshot_id) =
+        seconds(|| rustic::create_snapshot(repository_path, PASSWORD, &sources, &tags))?;
+    // Nothing changed, measures the walk and the index lookups of an incremental backup.
+    let mut unchanged = Vec::with_capacity(repeat);
+    for _ in 0..repeat {
+        unchanged.push(
+            seconds(|| rustic::create_snapshot(repository_path, PASSWORD, &sources, &tags))?.0,
+        );
+    }
+
+    let source_sets = subdirectories(source)?;
+    let (open_session, handle) = seconds(|| rustic::open_session(repository_path, PASSWORD))?;
+    let session_snapshots =
+        seconds(|| rustic::session_create_snapshots(handle, &source_sets, &tags, None));
+    rustic::close_session(handle)?;
+    let (session_snapshots, _) = session_snapshots?;
+
+    let mut restore = Vec::with_capacity(repeat);
+    for i in 0..repeat {
+        let destination = work.join(format!("restore-{i}"));
+        let destination_path = destination.to_str().ok_or("work_dir is not UTF-8")?;
+        restore.push(
+            seconds(|| {
+                rustic::restore_snapshot(repository_path, PASSWORD, &snapshot_id, destination_path)
+            })?
+            .0,
+        );
+        fs::remove_dir_all(&destination)?;
+    }
+
+    println!(
+        "{{\"init_s\": {init:.6}, \"cold_snapshot_s\": {cold:.6}, \"unchanged_snapshot_s\": {:.6}, \
+         \"open_session_s\": {open_session:.6}, \"session_snapshots_s\": {session_snapshots:.6}, \
+         \"session_source_sets\": {}, \"restore_s\": {:.6}}}",
+        median(unchanged),
+        source_sets.len(),
+        median(restore),
+    );
+
+    fs::remove_dir_all(work)?;
+    Ok(())
+}
@@ -1,14 +1,20 @@
+use std::sync::Arc;
+
 use jni::EnvUnowned;
 use jni::errors::ThrowRuntimeExAndDefault;
 use jni::objects::{JObject, JObjectArray, JString};
-use jni::sys::jboolean;
+use jni::sys::{jboolean, jlong};
 
 use crate::error::NativeError;
 use crate::jni_progress::JniProgressCallback;
+use crate::progress::RusticProgressCallback;
 use crate::repository::{
     check_repository, create_snapshot, create_snapshot_with_progress, init_repository,
     repository_exists, restore_snapshot, validate_repository,
 };
+use crate::session::{
+    close_session, open_session, session_create_snapshots, session_restore_snapshot,
+};
 
 #[unsafe(no_mangle)]
 pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeInitLogger<'local>(
@@ -141,6 +147,107 @@ pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeCheckRepository<'lo
         .resolve::<ThrowRuntimeExAndDefault>()
 }
 
+#[unsafe(no_mangle)]
+pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeOpenSession<'local>(
+    mut unowned_env: EnvUnowned<'local>,
+    _this: JObject<'local>,
+    repository_path: JString<'local>,
+    password: JString<'local>,
+) -> jlong {
+    unowned_env
+        .with_env(|_env| -> Result<jlong, NativeError> {
+            open_session(&repository_path.to_string(), &password.to_string())
+                .map_err(NativeError::from)
+        })
+        .resolve::<ThrowRuntimeExAndDefault>()
+}
+
+/// `source_sets` holds the paths of all sets, each set terminated by an empty string.
+/// Returns the snapshot IDs in set order, separated by line breaks.
+#[unsafe(no_mangle)]
+pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeCreateSessionSnapshots<'local>(
+    mut unowned_env: EnvUnowned<'local>,
+    _this: JObject<'local>,
+    session: jlong,
+    source_sets: JObjectArray<'local, JString<'local>>,
+    tags: JObjectArray<'local, JString<'local>>,
+    callback: JObject<'local>,
+) -> JString<'local> {
+    unowned_env
+        .with_env(|env| -> Result<JString<'local>, NativeError> {
+            let mut sets = vec![Vec::new()];
+            for path in string_array_to_vec(env, &source_sets)? {
+                if path.is_empty() {
+                    sets.push(Vec::new());
+                } else {
+                    sets.last_mut().unwrap().push(path);
+                }
+            }
+            if sets.last().is_some_and(Vec::is_empty) {
+                sets.pop();
+            }
+            let tags = string_array_to_vec(env, &tags)?;
+            let callback = progress_callback(env, &callback)?;
+            let snapshot_ids = session_create_snapshots(session, &sets, &tags, callback)
+                .map_err(NativeError::from)?;
+
+            env.new_string(snapshot_ids.join("\n"))
+                .map_err(NativeError::from)
+        })
+        .resolve::<ThrowRuntimeExAndDefault>()
+}
+
+#[unsafe(no_mangle)]
+pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeRestoreSessionSnapshot<'local>(
+    mut unowned_env: EnvUnowned<'local>,
+    _this: JObject<'local>,
+    session: jlong,
+    snapshot_id: JString<'local>,
+    destination_path: JString<'local>,
+    callback: JObject<'local>,
+) {
+    unowned_env
+        .with_env(|env| -> Result<(), NativeError> {
+            let callback = progress_callback(env, &callback)?;
+            session_restore_snapshot(
+                session,
+                &snapshot_id.to_string(),
+                &destination_path.to_string(),
+                callback,
+            )
+            .map_err(NativeError::from)
+        })
+        .resolve::<ThrowRuntimeExAndDefault>()
+}
+
+#[unsafe(no_mangle)]
+pub extern "system" fn Java_com_xayah_libnative_Rustic_nativeCloseSession<'local>(
+    mut unowned_env: EnvUnowned<'local>,
+    _this: JObject<'local>,
+    session: jlong,
+) -> jboolean {
+    unowned_env
+        .with_env(|_env| -> Result<jboolean, NativeError> {
+            close_session(session)
+                .map(jboolean::from)
+                .map_err(NativeError::from)
+        })
+        .resolve::<ThrowRuntimeExAndDefault>()
+}
+
+fn progress_callback<'local>(
+    env: &mut jni::Env<'local>,
+    callback: &JObject<'local>,
+) -> Result<Option<Arc<dyn RusticProgressCallback>>, NativeError> {
+    if callback.as_raw().is_null() {
+        return Ok(None);
+    }
+    let vm = env.get_java_vm()?;
+    // Progress is reported from rustic worker threads.
+    let callback = env.new_global_ref(callback)?;
+    Ok(Some(Arc::new(JniProgressCallback::new(env, vm, callback)?)))
+}
+
 fn string_array_to_vec<'local>(
     env: &mut jni::Env<'local>,
     array: &JObjectArray<'local, JString<'local>>,
@@ -7,6 +7,8 @@ mod jni_bridge;
 mod jni_progress;
 mod progress;
 mod repository;
+mod session;
+mod trace;
 
 pub type Result<T> = std::result::Result<T, Box<dyn Error>>;
 
@@ -15,3 +17,4 @@ pub use repository::{
     check_repository, create_snapshot, create_snapshot_with_progress, init_repository,
     repository_exists, restore_snapshot, validate_repository,
 };
+pub use session::{close_session, open_session, session_create_snapshots, session_restore_snapshot};
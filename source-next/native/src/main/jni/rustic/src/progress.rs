@@ -1,4 +1,4 @@
-use std::sync::{Arc, Mutex};
+use std::sync::{Arc, Mutex, PoisonError};
 use std::time::{Duration, Instant};
 
 use rustic_core::{Progress, ProgressBars, ProgressType, RusticProgress};
@@ -34,6 +34,29 @@ impl ProgressBars for AndroidProgressBars {
     }
 }
 
+/// Progress bars of a repository that outlives single operations, each operation installs
+/// its own callback before it starts and removes it when done.
+#[derive(Debug, Default, Clone)]
+pub(crate) struct SessionProgressBars {
+    callback: Arc<Mutex<Option<Arc<dyn RusticProgressCallback>>>>,
+}
+
+impl SessionProgressBars {
+    pub(crate) fn set_callback(&self, callback: Option<Arc<dyn RusticProgressCallback>>) {
+        *self.callback.lock().unwrap_or_else(PoisonError::into_inner) = callback;
+    }
+}
+
+impl ProgressBars for SessionProgressBars {
+    fn progress(&self, progress_type: ProgressType, _prefix: &str) -> Progress {
+        let callback = self.callback.lock().unwrap_or_else(PoisonError::into_inner).clone();
+        match (progress_type, callback) {
+            (ProgressType::Bytes, Some(callback)) => Progress::new(AndroidProgress::new(callback)),
+            _ => Progress::hidden(),
+        }
+    }
+}
+
 #[derive(Debug)]
 struct AndroidProgress {
     callback: Arc<dyn RusticProgressCallback>,
@@ -59,14 +82,21 @@ impl RusticProgress for AndroidProgress {
     }
 
     fn set_length(&self, len: u64) {
-        self.state.lock().unwrap().set_length(len);
+        self.state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .set_length(len);
     }
 
     fn set_title(&self, _title: &str) {}
 
     fn inc(&self, inc: u64) {
         let now = Instant::now();
-        let event = self.state.lock().unwrap().advance(inc, now, false);
+        let event = self
+            .state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .advance(inc, now, false);
         if let Some(event) = event {
             self.emit(event.bytes_done, event.speed, event.progress);
         }
@@ -75,7 +105,11 @@ impl RusticProgress for AndroidProgress {
     fn finish(&self) {
         let now = Instant::now();
         // Always finish with the average speed across the complete transfer.
-        let event = self.state.lock().unwrap().advance(0, now, true);
+        let event = self
+            .state
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner)
+            .advance(0, now, true);
         if let Some(event) = event {
             self.emit(event.bytes_done, event.speed, event.progress);
         }
@@ -187,11 +221,9 @@ mod tests {
         let mut state = ThrottledProgressState::new(start);
 
         assert_eq!(state.advance(1024, start, false).unwrap().bytes_done, 1024);
-        assert!(
-            state
-                .advance(1024, start + Duration::from_millis(999), false)
-                .is_none()
-        );
+        assert!(state
+            .advance(1024, start + Duration::from_millis(999), false)
+            .is_none());
 
         let event = state
             .advance(1024, start + Duration::from_secs(1), false)
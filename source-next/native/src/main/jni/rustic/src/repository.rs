@@ -1,12 +1,13 @@
 use rustic_backend::BackendOptions;
 use rustic_core::{
-    BackupOptions, CheckOptions, ConfigOptions, Credentials, KeyOptions, LocalDestination,
-    LsOptions, OpenStatus, PathList, Repository, RepositoryBackends, RepositoryOptions,
-    RestoreOptions, SnapshotOptions,
+    BackupOptions, CheckOptions, ConfigOptions, Credentials, IndexedFull, IndexedIds, KeyOptions,
+    LocalDestination, LsOptions, OpenStatus, PathList, Repository, RepositoryBackends,
+    RepositoryOptions, RestoreOptions, SnapshotOptions,
 };
 
 use crate::Result;
 use crate::progress::{AndroidProgressBars, RusticProgressCallback};
+use crate::trace::Span;
 
 pub fn init_repository(repository_path: &str, password: &str) -> Result<()> {
     let credentials = Credentials::password(password);
@@ -64,7 +65,15 @@ fn create_snapshot_from_repository(
     source_paths: &[String],
     tags: &[String],
 ) -> Result<String> {
-    let repo = repo.to_indexed_ids()?;
+    backup_sources(&repo.to_indexed_ids()?, source_paths, tags)
+}
+
+pub(crate) fn backup_sources<S: IndexedIds>(
+    repo: &Repository<S>,
+    source_paths: &[String],
+    tags: &[String],
+) -> Result<String> {
+    let _span = Span::new(c"rustic.backup");
     let source = source_paths
         .iter()
         .map(std::path::PathBuf::from)
@@ -90,7 +99,19 @@ pub fn restore_snapshot(
     snapshot_id: &str,
     destination_path: &str,
 ) -> Result<()> {
-    let repo = open_repository(repository_path, password)?.to_indexed()?;
+    restore_from_repository(
+        &open_repository(repository_path, password)?.to_indexed()?,
+        snapshot_id,
+        destination_path,
+    )
+}
+
+pub(crate) fn restore_from_repository<S: IndexedFull>(
+    repo: &Repository<S>,
+    snapshot_id: &str,
+    destination_path: &str,
+) -> Result<()> {
+    let _span = Span::new(c"rustic.restore");
     let node = repo.node_from_snapshot_path(snapshot_id, |_| true)?;
     let ls_options = LsOptions::default();
     let nodes = repo.ls(&node, &ls_options)?;
@@ -113,6 +134,7 @@ pub fn check_repository(repository_path: &str, password: &str) -> Result<()> {
 }
 
 fn open_repository(repository_path: &str, password: &str) -> Result<Repository<OpenStatus>> {
+    let _span = Span::new(c"rustic.open");
     Ok(
         Repository::new(&RepositoryOptions::default(), &backends(repository_path)?)?
             .open(&Credentials::password(password))?,
@@ -124,6 +146,7 @@ fn open_repository_with_progress<C: RusticProgressCallback>(
     password: &str,
     callback: C,
 ) -> Result<Repository<OpenStatus>> {
+    let _span = Span::new(c"rustic.open");
     Ok(Repository::new_with_progress(
         &RepositoryOptions::default(),
         &backends(repository_path)?,
@@ -132,7 +155,7 @@ fn open_repository_with_progress<C: RusticProgressCallback>(
     .open(&Credentials::password(password))?)
 }
 
-fn backends(repository_path: &str) -> Result<RepositoryBackends> {
+pub(crate) fn backends(repository_path: &str) -> Result<RepositoryBackends> {
     Ok(BackendOptions::default()
         .repository(repository_path)
         .to_backends()?)
@@ -0,0 +1,186 @@
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicI64, AtomicUsize, Ordering};
+use std::sync::{Arc, LazyLock, Mutex};
+use std::thread;
+
+use rustic_core::{Credentials, FullIndex, IndexedStatus, OpenStatus, Repository, RepositoryOptions};
+
+use crate::Result;
+use crate::progress::{RusticProgressCallback, SessionProgressBars};
+use crate::repository::{backends, backup_sources, restore_from_repository};
+use crate::trace::Span;
+
+// Every backup already runs its own reader/packer pipeline, a few at once keep the storage busy.
+const MAX_PARALLEL_SOURCE_SETS: usize = 4;
+const LOCK_POISONED: &str = "rustic session lock poisoned";
+
+type IndexedRepository = Repository<IndexedStatus<FullIndex, OpenStatus>>;
+
+/// An opened repository with its key and full index kept in memory, so consecutive
+/// snapshots and restores skip key derivation and config reads.
+///
+/// The index is loaded by the first operation that needs it. A backup marks it stale and
+/// the next operation of the session loads it again, so later backups dedupe against
+/// it and its snapshots can be restored through the same session, while a session
+/// ending with a backup never reloads it. Source sets backed up in parallel don't see
+/// each other's blobs, content they share is stored twice until the next prune.
+struct Session {
+    // Kept to load the index without deriving the key again.
+    open: Repository<OpenStatus>,
+    // None until loaded and again once a backup made it stale.
+    repo: Mutex<Option<Arc<IndexedRepository>>>,
+    progress: SessionProgressBars,
+    // Progress callbacks are per operation, so operations of one session run one after another.
+    operation: Mutex<()>,
+}
+
+impl Session {
+    /// Returns the index, loading it first if there is none yet or it went stale.
+    fn indexed(&self) -> Result<Arc<IndexedRepository>> {
+        let mut repo = self.repo.lock().map_err(|_| LOCK_POISONED)?;
+        if let Some(repo) = repo.as_ref() {
+            return Ok(repo.clone());
+        }
+        let _span = Span::new(c"rustic.load_index");
+        let loaded = Arc::new(self.open.clone().to_indexed()?);
+        *repo = Some(loaded.clone());
+        Ok(loaded)
+    }
+
+    /// Drops the index after a backup wrote packs and index files it doesn't know yet.
+    fn invalidate_index(&self) -> Result<()> {
+        *self.repo.lock().map_err(|_| LOCK_POISONED)? = None;
+        Ok(())
+    }
+}
+
+static SESSIONS: LazyLock<Mutex<HashMap<i64, Arc<Session>>>> =
+    LazyLock::new(|| Mutex::new(HashMap::new()));
+static NEXT_SESSION: AtomicI64 = AtomicI64::new(1);
+
+/// Opens the repository at `repository_path` and returns a handle for the `session_*` functions.
+pub fn open_session(repository_path: &str, password: &str) -> Result<i64> {
+    let _span = Span::new(c"rustic.open_session");
+    let progress = SessionProgressBars::default();
+    let open = Repository::new_with_progress(
+        &RepositoryOptions::default(),
+        &backends(repository_path)?,
+        progress.clone(),
+    )?
+    .open(&Credentials::password(password))?;
+
+    let handle = NEXT_SESSION.fetch_add(1, Ordering::Relaxed);
+    SESSIONS.lock().map_err(|_| LOCK_POISONED)?.insert(
+        handle,
+        Arc::new(Session {
+            open,
+            repo: Mutex::new(None),
+            progress,
+            operation: Mutex::new(()),
+        }),
+    );
+
+    Ok(handle)
+}
+
+/// Drops the session, calls still running on it finish first. Returns false for unknown handles.
+pub fn close_session(handle: i64) -> Result<bool> {
+    Ok(SESSIONS
+        .lock()
+        .map_err(|_| LOCK_POISONED)?
+        .remove(&handle)
+        .is_some())
+}
+
+/// Backs up every set of `source_sets` into a snapshot of its own, up to
+/// [MAX_PARALLEL_SOURCE_SETS] at once. Each backup marks the index stale, sets started
+/// after it and the next operation of the session load it again.
+/// Returns the snapshot IDs in the order of `source_sets`.
+pub fn session_create_snapshots(
+    handle: i64,
+    source_sets: &[Vec<String>],
+    tags: &[String],
+    callback: Option<Arc<dyn RusticProgressCallback>>,
+) -> Result<Vec<String>> {
+    let session = session(handle)?;
+    let _operation = session.operation.lock().map_err(|_| LOCK_POISONED)?;
+    session.progress.set_callback(callback);
+
+    let next = AtomicUsize::new(0);
+    let workers = source_sets.len().clamp(1, MAX_PARALLEL_SOURCE_SETS);
+    let results = thread::scope(|scope| {
+        let handles = (0..workers)
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut done = Vec::new();
+                    loop {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+                        let Some(source_paths) = source_sets.get(index) else {
+                            break done;
+                        };
+                        // Errors are not Send, keep their message only.
+                        let result = session
+                            .indexed()
+                            .and_then(|repo| {
+                                let snapshot_id = backup_sources(&repo, source_paths, tags)?;
+                                session.invalidate_index()?;
+                                Ok(snapshot_id)
+                            })
+                            .map_err(|err| err.to_string());
+                        let failed = result.is_err();
+                        done.push((index, result));
+                        if failed {
+                            // Let the other workers drain the queue without starting new sets.
+                            next.store(source_sets.len(), Ordering::Relaxed);
+                            break done;
+                        }
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+        handles
+            .into_iter()
+            .map(|handle| handle.join())
+            .collect::<Vec<_>>()
+    });
+    session.progress.set_callback(None);
+
+    let mut snapshot_ids = vec![String::new(); source_sets.len()];
+    let results = results
+        .into_iter()
+        .collect::<std::result::Result<Vec<_>, _>>()
+        .map_err(|_| "rustic backup worker panicked")?
+        .into_iter()
+        .flatten();
+    for (index, result) in results {
+        snapshot_ids[index] = result?;
+    }
+
+    Ok(snapshot_ids)
+}
+
+pub fn session_restore_snapshot(
+    handle: i64,
+    snapshot_id: &str,
+    destination_path: &str,
+    callback: Option<Arc<dyn RusticProgressCallback>>,
+) -> Result<()> {
+    let session = session(handle)?;
+    let _operation = session.operation.lock().map_err(|_| LOCK_POISONED)?;
+    session.progress.set_callback(callback);
+    let result = session
+        .indexed()
+        .and_then(|repo| restore_from_repository(&repo, snapshot_id, destination_path));
+    session.progress.set_callback(None);
+
+    result
+}
+
+fn session(handle: i64) -> Result<Arc<Session>> {
+    SESSIONS
+        .lock()
+        .map_err(|_| LOCK_POISONED)?
+        .get(&handle)
+        .cloned()
+        .ok_or_else(|| format!("unknown rustic session {handle}").into())
+}
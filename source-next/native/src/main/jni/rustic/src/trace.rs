@@ -0,0 +1,41 @@
+//! Spans recorded into the shared buffers of libtrace, see `trace/trace.h`.
+//! Host builds (cargo test) have no libtrace, spans are no-ops there.
+
+use std::ffi::CStr;
+
+#[cfg(target_os = "android")]
+unsafe extern "C" {
+    fn trace_span_begin() -> u64;
+    fn trace_span_end(name: *const std::ffi::c_char, start_ns: u64);
+}
+
+/// Records its lifetime as a span of the current thread while tracing is enabled.
+pub(crate) struct Span {
+    #[cfg_attr(not(target_os = "android"), allow(dead_code))]
+    name: &'static CStr,
+    #[cfg_attr(not(target_os = "android"), allow(dead_code))]
+    start_ns: u64,
+}
+
+impl Span {
+    /// `name` is "<category>.<what>" like the native spans, e.g. `c"rustic.backup"`.
+    pub(crate) fn new(name: &'static CStr) -> Self {
+        #[cfg(target_os = "android")]
+        // SAFETY: plain C function without preconditions.
+        let start_ns = unsafe { trace_span_begin() };
+        #[cfg(not(target_os = "android"))]
+        let start_ns = 0;
+
+        Self { name, start_ns }
+    }
+}
+
+impl Drop for Span {
+    fn drop(&mut self) {
+        #[cfg(target_os = "android")]
+        // SAFETY: `name` is a 'static NUL terminated string, libtrace keeps the pointer.
+        unsafe {
+            trace_span_end(self.name.as_ptr(), self.start_ns)
+        };
+    }
+}
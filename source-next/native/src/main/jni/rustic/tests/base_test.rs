@@ -144,6 +144,48 @@ fn create_and_restore_snapshot_with_multiple_direct_sources() -> Result<(), Box<
     Ok(())
 }
 
+#[test]
+fn session_snapshots_parallel_source_sets_and_restores() -> Result<(), Box<dyn Error>> {
+    let root = temp_path("session-snapshots")?;
+    let repository = root.join("repo");
+    let repository_path = repository.to_str().unwrap();
+    let password = "password";
+
+    let source_sets = (0..6)
+        .map(|index| {
+            let source = root.join(format!("app-{index}"));
+            fs::create_dir_all(&source)?;
+            fs::write(source.join(format!("data-{index}.txt")), format!("app {index}"))?;
+            Ok(vec![source.to_string_lossy().into_owned()])
+        })
+        .collect::<Result<Vec<_>, Box<dyn Error>>>()?;
+
+    rustic::init_repository(repository_path, password)?;
+    let session = rustic::open_session(repository_path, password)?;
+    let snapshot_ids = rustic::session_create_snapshots(
+        session,
+        &source_sets,
+        &["databackup".to_string()],
+        None,
+    )?;
+    assert_eq!(snapshot_ids.len(), source_sets.len());
+    // The index is reloaded after every backup, so the session restores its own snapshots.
+    for (index, snapshot_id) in snapshot_ids.iter().enumerate() {
+        let restore = root.join(format!("restore-{index}"));
+        rustic::session_restore_snapshot(session, snapshot_id, restore.to_str().unwrap(), None)?;
+        let restored = find_file(&restore, &format!("data-{index}.txt"))?;
+        assert_eq!(fs::read_to_string(restored)?, format!("app {index}"));
+    }
+    assert!(rustic::close_session(session)?);
+    assert!(!rustic::close_session(session)?);
+    assert!(rustic::session_create_snapshots(session, &source_sets, &[], None).is_err());
+    rustic::check_repository(repository_path, password)?;
+    assert!(rustic::open_session(repository_path, "incorrect").is_err());
+
+    fs::remove_dir_all(root)?;
+    Ok(())
+}
+
 fn run_snapshot_lifecycle(
     temp_name: &str,
     file_name: &str,
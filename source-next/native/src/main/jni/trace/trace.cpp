@@ -0,0 +1,291 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <jni.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <android/log.h>
+
+#define LOG_TAG "Trace"
+#define ALOGV(...) __android_log_print(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace TraceNS {
+    namespace {
+        // Per thread, older spans are overwritten. 32 bytes each.
+        constexpr uint64_t RING_CAPACITY = 8192;
+        static_assert((RING_CAPACITY & (RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two");
+
+        const char *const COUNTER_NAMES[COUNTER_COUNT] = {
+                "stat_calls",
+                "entries_visited",
+                "bytes_hashed",
+                "bytes_read",
+                "bytes_compressed",
+                "bytes_decompressed",
+                "pipe_blocked_ns",
+                "write_blocked_ns",
+        };
+
+        struct Event {
+            std::atomic<const char *> name{nullptr};
+            std::atomic<uint64_t> start_ns{0};
+            std::atomic<uint64_t> duration_ns{0};
+            std::atomic<uint32_t> tid{0};
+        };
+
+        /**
+         * Written only by the thread owning it, read by dumps from any thread.
+         *
+         * A span claims its slot by bumping mClaimed before writing it and publishes it
+         * through mPublished afterwards, a reader that raced with the writer sees the
+         * claim and drops the slot (a seqlock over the whole ring).
+         */
+        struct ThreadBuffer {
+            std::atomic<uint64_t> claimed{0};
+            std::atomic<uint64_t> published{0};
+            std::atomic<uint64_t> counters[COUNTER_COUNT]{};
+            std::atomic<uint32_t> tid{0};
+            Event events[RING_CAPACITY];
+        };
+
+        std::atomic<bool> gEnabled{false};
+        std::atomic<uint64_t> gResetAt{0};
+
+        // Buffers are never freed, a buffer of an exited thread is handed to the next new one.
+        std::mutex gBuffersLock;
+        std::vector<ThreadBuffer *> gBuffers;
+        std::vector<ThreadBuffer *> gFreeBuffers;
+
+        struct ThreadSlot {
+            ThreadBuffer *buffer = nullptr;
+
+            ~ThreadSlot() {
+                if (buffer == nullptr) return;
+                std::lock_guard<std::mutex> lock(gBuffersLock);
+                gFreeBuffers.push_back(buffer);
+            }
+        };
+
+        thread_local ThreadSlot tSlot;
+
+        ThreadBuffer *thread_buffer() {
+            if (tSlot.buffer != nullptr) return tSlot.buffer;
+            std::lock_guard<std::mutex> lock(gBuffersLock);
+            if (gFreeBuffers.empty()) {
+                gBuffers.push_back(new ThreadBuffer());
+                tSlot.buffer = gBuffers.back();
+            } else {
+                tSlot.buffer = gFreeBuffers.back();
+                gFreeBuffers.pop_back();
+            }
+            tSlot.buffer->tid.store(static_cast<uint32_t>(syscall(SYS_gettid)), std::memory_order_relaxed);
+            return tSlot.buffer;
+        }
+
+        struct RecordedSpan {
+            const char *name;
+            uint64_t start_ns;
+            uint64_t duration_ns;
+            uint32_t tid;
+        };
+
+        void collect_spans(const ThreadBuffer &buffer, uint64_t since_ns, std::vector<RecordedSpan> &spans) {
+            uint64_t published = buffer.published.load(std::memory_order_acquire);
+            uint64_t first = published > RING_CAPACITY ? published - RING_CAPACITY : 0;
+            size_t begin = spans.size();
+            for (uint64_t i = first; i < published; i++) {
+                const Event &event = buffer.events[i & (RING_CAPACITY - 1)];
+                spans.push_back(RecordedSpan{
+                        event.name.load(std::memory_order_relaxed),
+                        event.start_ns.load(std::memory_order_relaxed),
+                        event.duration_ns.load(std::memory_order_relaxed),
+                        event.tid.load(std::memory_order_relaxed),
+                });
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t claimed = buffer.claimed.load(std::memory_order_relaxed);
+            // Slots below this index may have been rewritten while they were copied.
+            uint64_t valid_from = claimed > RING_CAPACITY ? claimed - RING_CAPACITY : 0;
+            size_t torn = static_cast<size_t>(std::min(published, std::max(first, valid_from)) - first);
+            spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(begin),
+                        spans.begin() + static_cast<std::ptrdiff_t>(begin + torn));
+            spans.erase(std::remove_if(spans.begin() + static_cast<std::ptrdiff_t>(begin), spans.end(),
+                                       [since_ns](const RecordedSpan &span) { return span.name == nullptr || span.start_ns < since_ns; }),
+                        spans.end());
+        }
+
+        void write_json_string(FILE *file, const char *str) {
+            fputc('"', file);
+            for (; *str != '\0'; str++) {
+                unsigned char c = static_cast<unsigned char>(*str);
+                if (c == '"' || c == '\\') {
+                    fputc('\\', file);
+                    fputc(c, file);
+                } else if (c < 0x20) {
+                    fprintf(file, "\\u%04x", c);
+                } else {
+                    fputc(c, file);
+                }
+            }
+            fputc('"', file);
+        }
+
+        std::string category_of(const char *name) {
+            const char *dot = strchr(name, '.');
+            return dot == nullptr ? std::string(name) : std::string(name, dot - name);
+        }
+
+        void counter_totals(uint64_t totals[COUNTER_COUNT]) {
+            std::fill(totals, totals + COUNTER_COUNT, 0);
+            std::lock_guard<std::mutex> lock(gBuffersLock);
+            for (ThreadBuffer *buffer: gBuffers) {
+                for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+                    totals[i] += buffer->counters[i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    void set_enabled(bool enabled) {
+        gEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    bool enabled() {
+        return gEnabled.load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+        gResetAt.store(now_ns(), std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(gBuffersLock);
+        for (ThreadBuffer *buffer: gBuffers) {
+            for (auto &counter: buffer->counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    uint64_t now_ns() {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    std::string counters_json() {
+        uint64_t totals[COUNTER_COUNT];
+        counter_totals(totals);
+        std::string json = "{";
+        for (uint32_t i = 0; i < COUNTER_COUNT; i++) {
+            char buffer[96];
+            snprintf(buffer, sizeof(buffer), "%s\"%s\":%" PRIu64, i == 0 ? "" : ",", COUNTER_NAMES[i], totals[i]);
+            json += buffer;
+        }
+        json += "}";
+        return json;
+    }
+
+    bool dump_chrome_trace(const std::string &path) {
+        std::vector<RecordedSpan> spans;
+        uint64_t since_ns = gResetAt.load(std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(gBuffersLock);
+            for (ThreadBuffer *buffer: gBuffers) {
+                collect_spans(*buffer, since_ns, spans);
+            }
+        }
+        std::sort(spans.begin(), spans.end(), [](const RecordedSpan &a, const RecordedSpan &b) { return a.start_ns < b.start_ns; });
+
+        FILE *file = fopen(path.c_str(), "we");
+        if (file == nullptr) {
+            ALOGE("Failed to open '%s': %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        int pid = getpid();
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"databackup-root\"}}", pid);
+        for (const RecordedSpan &span: spans) {
+            fprintf(file, ",\n{\"name\":");
+            write_json_string(file, span.name);
+            fprintf(file, ",\"cat\":");
+            write_json_string(file, category_of(span.name).c_str());
+            fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+                    static_cast<double>(span.start_ns) / 1000.0, static_cast<double>(span.duration_ns) / 1000.0, pid, span.tid);
+        }
+        fprintf(file, "\n],\"otherData\":%s}\n", counters_json().c_str());
+        bool written = ferror(file) == 0;
+        if (fclose(file) != 0) written = false;
+        if (written) {
+            ALOGI("Dumped %zu spans to '%s'.", spans.size(), path.c_str());
+        } else {
+            ALOGE("Failed to write '%s': %s", path.c_str(), strerror(errno));
+        }
+        return written;
+    }
+}
+
+using namespace TraceNS;
+
+extern "C" {
+void trace_counter_add(uint32_t counter, uint64_t value) {
+    if (counter >= COUNTER_COUNT) return;
+    thread_buffer()->counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t trace_span_begin() {
+    return enabled() ? now_ns() : 0;
+}
+
+void trace_span_end(const char *name, uint64_t start_ns) {
+    if (start_ns == 0) return;
+    uint64_t end_ns = now_ns();
+    ThreadBuffer *buffer = thread_buffer();
+    uint64_t index = buffer->claimed.load(std::memory_order_relaxed);
+    buffer->claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Event &event = buffer->events[index & (RING_CAPACITY - 1)];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+    event.tid.store(buffer->tid.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    buffer->published.store(index + 1, std::memory_order_release);
+}
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_xayah_libnative_Trace_setEnabled(JNIEnv *, jobject, jboolean enabled) {
+    set_enabled(enabled);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_com_xayah_libnative_Trace_reset(JNIEnv *, jobject) {
+    reset();
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_xayah_libnative_Trace_readCounters(JNIEnv *env, jobject) {
+    return env->NewStringUTF(counters_json().c_str());
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_com_xayah_libnative_Trace_dumpChromeTrace(JNIEnv *env, jobject, jstring path) {
+    const char *path_chars = env->GetStringUTFChars(path, nullptr);
+    bool dumped = dump_chrome_trace(path_chars);
+    env->ReleaseStringUTFChars(path, path_chars);
+    return dumped;
+}
@@ -0,0 +1,102 @@
+#ifndef TRACE_TRACE_H
+#define TRACE_TRACE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Plain C entry points for rustic, `counter` is a TraceNS::Counter and `name` must
+ * stay valid for the life of the process (a string literal).
+ * trace_span_begin() returns 0 while tracing is disabled, trace_span_end() then does nothing.
+ */
+extern "C" {
+void trace_counter_add(uint32_t counter, uint64_t value);
+uint64_t trace_span_begin();
+void trace_span_end(const char *name, uint64_t start_ns);
+}
+
+namespace TraceNS {
+    // Keep in sync with COUNTER_NAMES in trace.cpp and the constants in rustic/src/trace.rs.
+    enum Counter : uint32_t {
+        STAT_CALLS,
+        ENTRIES_VISITED,
+        BYTES_HASHED,
+        // Uncompressed tar stream read from the tar child or passed to it.
+        BYTES_READ,
+        BYTES_COMPRESSED,
+        BYTES_DECOMPRESSED,
+        // Time spent waiting for the tar child to fill or drain the pipe.
+        PIPE_BLOCKED_NS,
+        // Time spent in write() to the output file or fd.
+        WRITE_BLOCKED_NS,
+        COUNTER_COUNT,
+    };
+
+    /**
+     * Spans are recorded only while enabled, counters are always updated.
+     */
+    void set_enabled(bool enabled);
+
+    bool enabled();
+
+    /**
+     * Zeroes all counters and drops the recorded spans.
+     */
+    void reset();
+
+    uint64_t now_ns();
+
+    inline void add(Counter counter, uint64_t value) {
+        trace_counter_add(counter, value);
+    }
+
+    /**
+     * Records the lifetime of the object as a span of the calling thread.
+     * `name` is "<category>.<what>", e.g. "tar.compress", and must be a string literal.
+     */
+    class Span {
+    public:
+        explicit Span(const char *name) : mName(name), mStart(trace_span_begin()) {}
+
+        ~Span() { trace_span_end(mName, mStart); }
+
+        Span(const Span &) = delete;
+
+        Span &operator=(const Span &) = delete;
+
+    private:
+        const char *mName;
+        uint64_t mStart;
+    };
+
+    /**
+     * Measures the lifetime of the object into `counter` as nanoseconds.
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Counter counter) : mCounter(counter), mStart(now_ns()) {}
+
+        ~ScopedTimer() { add(mCounter, now_ns() - mStart); }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        Counter mCounter;
+        uint64_t mStart;
+    };
+
+    /**
+     * Returns the totals of all threads as a JSON object keyed by counter name.
+     */
+    std::string counters_json();
+
+    /**
+     * Writes the recorded spans and the counter totals as Chrome trace event JSON
+     * (chrome://tracing, Perfetto) to `path`.
+     */
+    bool dump_chrome_trace(const std::string &path);
+}
+
+#endif //TRACE_TRACE_H
@@ -2,5 +2,36 @@ package com.xayah.libnative
 
 object NativeLib {
     external fun calculateTreeSize(path: String): Long
+
+    /**
+     * Walks all [paths] in parallel, sizes are returned in the same order.
+     */
+    external fun calculateTreeSizes(paths: Array<String>): LongArray
     external fun getUidGid(path: String): IntArray
+
+    /**
+     * Chowns everything below [path] to [uid]:[gid] in one pass, the top level cache and code_cache
+     * directories and their contents to [uid]:[cacheGid], and drops setuid/setgid bits from files.
+     * Returns the number of entries that could not be fixed, or -1 if [path] does not exist.
+     */
+    external fun fixOwnership(path: String, uid: Int, gid: Int, cacheGid: Int): Int
+
+    /**
+     * Walks [roots] into a manifest staged next to [manifestPath] and compares it with the committed one.
+     * A committed manifest written for other [settings] counts as missing.
+     * Returns the number of added, removed or modified entries, or -1 if the scan failed.
+     */
+    external fun scanManifest(manifestPath: String, roots: Array<String>, settings: String): Long
+
+    /**
+     * Replaces the manifest at [manifestPath] with the one staged by [scanManifest].
+     */
+    external fun commitManifest(manifestPath: String): Boolean
+    external fun discardManifest(manifestPath: String)
+
+    /**
+     * Hashes all [paths] in parallel, returns "<sha256 tree digest>-<size>" content ids in the same order,
+     * or an empty string for files that could not be read.
+     */
+    external fun hashFiles(paths: Array<String>): Array<String>
 }
@@ -1,6 +1,9 @@
 package com.xayah.libnative
 
 object Rustic {
+    // Terminates each source set in the flattened path array passed to native.
+    private const val SOURCE_SET_END = ""
+
     fun initLogger() = nativeInitLogger()
 
     fun initRepository(repositoryPath: String, password: String) {
@@ -33,6 +36,38 @@ object Rustic {
         nativeCheckRepository(repositoryPath, password)
     }
 
+    /**
+     * Opens the repository once and keeps its key, and the index once loaded, in memory for the session calls below.
+     * Returns a handle that must be released with [closeSession].
+     */
+    fun openSession(repositoryPath: String, password: String): Long {
+        return nativeOpenSession(repositoryPath, password)
+    }
+
+    /**
+     * Creates one snapshot per entry of [sourceSets], several at once. Returns the snapshot IDs in the same order.
+     * Each backup marks the session index stale, the next session call reloads it, so later backups dedupe
+     * against the new snapshots and they can be restored through the same session.
+     */
+    fun createSessionSnapshots(
+        session: Long,
+        sourceSets: List<List<String>>,
+        tags: List<String> = emptyList(),
+        callback: Any? = null,
+    ): List<String> {
+        val sourcePaths = sourceSets.flatMap { it + SOURCE_SET_END }.toTypedArray()
+        val snapshotIds = nativeCreateSessionSnapshots(session, sourcePaths, tags.toTypedArray(), callback)
+        return if (snapshotIds.isEmpty()) emptyList() else snapshotIds.lines()
+    }
+
+    fun restoreSessionSnapshot(session: Long, snapshotId: String, destinationPath: String, callback: Any? = null) {
+        nativeRestoreSessionSnapshot(session, snapshotId, destinationPath, callback)
+    }
+
+    fun closeSession(session: Long): Boolean {
+        return nativeCloseSession(session)
+    }
+
     private external fun nativeInitLogger()
     private external fun nativeInitRepository(repositoryPath: String, password: String)
     private external fun nativeRepositoryExists(repositoryPath: String): Boolean
@@ -53,4 +88,21 @@ object Rustic {
     )
 
     private external fun nativeCheckRepository(repositoryPath: String, password: String)
+
+    private external fun nativeOpenSession(repositoryPath: String, password: String): Long
+    private external fun nativeCreateSessionSnapshots(
+        session: Long,
+        sourceSets: Array<String>,
+        tags: Array<String>,
+        callback: Any?,
+    ): String
+
+    private external fun nativeRestoreSessionSnapshot(
+        session: Long,
+        snapshotId: String,
+        destinationPath: String,
+        callback: Any?,
+    )
+
+    private external fun nativeCloseSession(session: Long): Boolean
 }
@@ -1,5 +1,77 @@
 package com.xayah.libnative
 
 object TarWrapper {
+    /**
+     * Returned by [poll] and [waitFor] instead of a tar exit code.
+     */
+    const val JOB_RUNNING = -2
+    const val JOB_CANCELED = -3
+    const val JOB_UNKNOWN = -4
+
+    /**
+     * Runs tar and blocks until it exited, returns the exit code or -1.
+     */
     external fun callCli(stdOut: String, stdErr: String, argv: Array<String>): Int
+
+    /**
+     * Same as [callCli] but returns a job id right away, or -1 if the job could not be created.
+     */
+    external fun spawnCli(stdOut: String, stdErr: String, argv: Array<String>): Long
+
+    /**
+     * Starts a job archiving [roots] and compressing the stream with zstd straight into [outputFd].
+     * If [adaptive], files are classified by content: already compressed ones use [fastLevel], text and
+     * databases [textLevel] and everything else [level].
+     * [progress] is a handle from [newProgress] receiving the compressed bytes written.
+     * [outputFd] is duplicated and may be closed once this returns.
+     */
+    external fun spawnArchive(
+        stdErr: String,
+        roots: Array<String>,
+        outputFd: Int,
+        level: Int,
+        adaptive: Boolean,
+        fastLevel: Int,
+        textLevel: Int,
+        workers: Int,
+        progress: Long
+    ): Long
+
+    /**
+     * Starts a job decompressing and extracting the tar.zst read from [inputFd] into [destination] in a
+     * read-ahead/zstd/tar pipeline. [progress] receives the compressed bytes read.
+     * [inputFd] is duplicated and may be closed once this returns.
+     */
+    external fun spawnExtract(stdErr: String, inputFd: Int, destination: String, progress: Long): Long
+
+    /**
+     * Returns the tar exit code of a finished job, [JOB_RUNNING], [JOB_CANCELED] or [JOB_UNKNOWN].
+     */
+    external fun poll(job: Long): Int
+
+    /**
+     * Same as [poll] but blocks up to [timeoutMs] for the job to finish, forever if negative.
+     */
+    external fun waitFor(job: Long, timeoutMs: Long): Int
+
+    /**
+     * Terminates the tar child of [job], a queued job never starts. Returns false if it already finished.
+     */
+    external fun cancel(job: Long): Boolean
+    external fun cancelAll()
+
+    /**
+     * Drops a finished job, its id is unknown afterwards.
+     */
+    external fun release(job: Long)
+
+    /**
+     * Archive and extract jobs spawned above [maxJobs] wait in a queue until a running one finished,
+     * cli jobs are short and never wait.
+     */
+    external fun setMaxJobs(maxJobs: Int)
+
+    external fun newProgress(): Long
+    external fun readProgress(progress: Long): Long
+    external fun freeProgress(progress: Long)
 }
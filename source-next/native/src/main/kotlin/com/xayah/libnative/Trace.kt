@@ -0,0 +1,27 @@
+package com.xayah.libnative
+
+/**
+ * Spans and counters recorded by nativelib, tar-wrapper and rustic, all of them share libtrace.
+ */
+object Trace {
+    /**
+     * Spans are only recorded while enabled, counters are always updated.
+     */
+    external fun setEnabled(enabled: Boolean)
+
+    /**
+     * Zeroes all counters and drops the recorded spans.
+     */
+    external fun reset()
+
+    /**
+     * Returns the counter totals of all threads as a JSON object, e.g. {"stat_calls":123,...}.
+     */
+    external fun readCounters(): String
+
+    /**
+     * Writes the recorded spans and counter totals as Chrome trace event JSON to [path],
+     * it opens in chrome://tracing or Perfetto.
+     */
+    external fun dumpChromeTrace(path: String): Boolean
+}